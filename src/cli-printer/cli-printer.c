@@ -107,6 +107,8 @@ static void parse_command_line(int argc, char * argv[])
 {
 	int c;
 	int i;
+	char * stats;
+	printer_driver_t hotplug;
 	//int file_index;
 	int option_index = 0;
 
@@ -116,6 +118,9 @@ static void parse_command_line(int argc, char * argv[])
 		{"output", required_argument, NULL, 'o'},
 		{"description", required_argument, NULL, 's'},
 		{"list", no_argument, NULL, 'l'},
+		{"stats", no_argument, NULL, 'S'},
+		{"install", required_argument, NULL, 'i'},
+		{"remove", required_argument, NULL, 'r'},
 		{"version", no_argument, NULL, 'v'},
 		{"usage", no_argument, NULL, 'u'},
 		{"help", no_argument, NULL, '?'}
@@ -137,7 +142,7 @@ static void parse_command_line(int argc, char * argv[])
 	strcpy(data, argv[argc-1]);
 	printf("Data: %s\n", data);
 
-	while((c = getopt_long(argc, argv, "d:o:s:lvu?", long_options, &option_index)) != -1)
+	while((c = getopt_long(argc, argv, "d:o:s:lSi:r:vu?", long_options, &option_index)) != -1)
 	{
 		
 		switch(c)
@@ -181,10 +186,30 @@ static void parse_command_line(int argc, char * argv[])
 				n = 0;
 				list = printer_list_drivers(&n);
 				
-				for(i = 0; i < n; i++) {
+				for(i = 0; list && i < n; i++) {
 					printf("printer_name=%s\n", list[i]->printer_name);
 				}
+				free(list);
 
+				free_pointers();
+				exit(0);
+				break;
+			case 'i': //Installs the driver at the given location into the -d group and quits
+			case 'r': //Uninstalls the named printer, from the -d group if one was given, and quits
+				hotplug.printer_name = optarg;
+				hotplug.driver_name = driver;
+				hotplug.driver_version = NULL;
+				i = c == 'i' ? printer_install_driver(optarg, hotplug) : printer_uninstall_driver(hotplug);
+				printf("%s %s: %d\n", c == 'i' ? "install" : "remove", optarg, i);
+				free_pointers();
+				exit(i ? 1 : 0);
+				break;
+			case 'S': //Prints out the server statistics and quits
+				stats = printer_stats();
+				if(stats) {
+					fputs(stats, stdout);
+					free(stats);
+				}
 				free_pointers();
 				exit(0);
 				break;
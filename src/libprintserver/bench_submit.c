@@ -0,0 +1,107 @@
+/**
+ * @file      bench_submit.c
+ * @date      2026-10-17: Created
+ * @brief     Compare the cost of submitting a job over the socket and the ring
+ * @copyright MIT License (c) 2015, 2016
+ *
+ * Submits the same job a number of times through printer_print(), once with
+ * the Unix socket and once with the shared memory ring, and reports the mean,
+ * median and 99th percentile time per call.  Each transport runs in its own
+ * process, as the transport is chosen once per process.  Needs a running
+ * print server; build with `make bench` and run from a directory next to the
+ * server's socket:
+ *
+ *     ./bench_submit <printer group> <file> [jobs]
+ */
+
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "print_server_client.h"
+
+/// The number of jobs submitted before timing starts
+#define WARMUP 50
+
+static long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static int compare_ll(const void * a, const void * b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Time jobs submissions of file to group through one transport
+ */
+static void run(const char * transport, char * group, char * file, int jobs)
+{
+	long long * times = malloc(jobs * sizeof(long long));
+	long long start, total = 0;
+	int i, handle, rejected = 0;
+
+	setenv("PRINT_SERVER_TRANSPORT", transport, 1);
+	for(i = 0; i < WARMUP; i++)
+		printer_print(&handle, group, "bench", NULL, file);
+	for(i = 0; i < jobs; i++)
+	{
+		start = now_ns();
+		if(printer_print(&handle, group, "bench", NULL, file))
+			rejected++;
+		times[i] = now_ns() - start;
+		total += times[i];
+	}
+	qsort(times, jobs, sizeof(long long), compare_ll);
+	printf("%-8s %8d jobs  mean %8.2f us  p50 %8.2f us  p99 %8.2f us  rejected %d\n",
+		transport, jobs, total / 1000.0 / jobs, times[jobs / 2] / 1000.0,
+		times[jobs * 99 / 100] / 1000.0, rejected);
+	free(times);
+}
+
+int main(int argc, char ** argv)
+{
+	const char * transports[] = { "socket", "shm" };
+	int jobs = 2000;
+	size_t t;
+
+	if(argc < 3)
+	{
+		fprintf(stderr, "usage: %s <printer group> <file> [jobs]\n", argv[0]);
+		return 1;
+	}
+	if(argc > 3)
+		jobs = atoi(argv[3]);
+	if(jobs <= 0)
+		return 1;
+
+	for(t = 0; t < sizeof(transports) / sizeof(transports[0]); t++)
+	{
+		fflush(stdout);
+		if(fork() == 0)
+		{
+			run(transports[t], argv[1], argv[2], jobs);
+			exit(0);
+		}
+		wait(NULL);
+	}
+	return 0;
+}
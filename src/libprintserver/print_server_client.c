@@ -22,38 +22,465 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 #include <unistd.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mqueue.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <linux/futex.h>
 
-#ifndef PRINT_SERVER_CLIENT_H
-#define PRINT_SERVER_CLIENT_H
+#include "print_server_client.h"
+#include "print_server_proto.h"
 
 char *socket_path = "\0hidden";
 
-typedef struct PRINTER_DRIVER_STRUCT printer_driver_t;
-/// A printer driver returned by printer_list_drivers()
-struct PRINTER_DRIVER_STRUCT
+/**
+ * Connect to the print server socket
+ * @return the connected socket, or -1 on error
+ */
+static int connect_server()
 {
-	/// The name of the printer
-	char* printer_name;
-	/// The driver name
-	char* driver_name;
-	/// The driver version
-	char* driver_version;
-};
+	struct sockaddr_un addr;
+	int fd;
+
+	socket_path="../socket";
+
+	if ( (fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		perror("socket error");
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (*socket_path == '\0') {
+		*addr.sun_path = '\0';
+		strncpy(addr.sun_path+1, socket_path+1, sizeof(addr.sun_path)-2);
+	} else {
+		strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path)-1);
+	}
 
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		perror("client connect error");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
 
+/**
+ * Write a whole buffer to the server
+ * @return 0 on success, -1 on error
+ */
+static int send_all(int fd, const char * buf, size_t len)
+{
+	ssize_t rc;
+
+	while(len)
+	{
+		rc = write(fd, buf, len);
+		if(rc == -1 && errno == EINTR)
+			continue;
+		if(rc <= 0)
+		{
+			perror("write error");
+			return -1;
+		}
+		buf += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+/**
+ * Write a whole buffer to the server, passing a file descriptor along with
+ * the first byte
+ * @return 0 on success, -1 on error
+ */
+static int send_with_fd(int fd, const char * buf, size_t len, int pass_fd)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov = { (void*)buf, len };
+	struct msghdr msg;
+	struct cmsghdr * cmsg;
+	ssize_t rc;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+
+	do {
+		rc = sendmsg(fd, &msg, 0);
+	} while(rc == -1 && errno == EINTR);
+	if(rc <= 0)
+	{
+		perror("sendmsg error");
+		return -1;
+	}
+	return send_all(fd, buf + rc, len - rc);
+}
+
+/**
+ * Read exactly len bytes from the server
+ * @return 0 on success, -1 on error or if the server hung up
+ */
+static int read_all(int fd, char * buf, size_t len)
+{
+	ssize_t rc;
+
+	while(len)
+	{
+		rc = read(fd, buf, len);
+		if(rc == -1 && errno == EINTR)
+			continue;
+		if(rc <= 0)
+		{
+			if(rc == -1)
+				perror("read");
+			return -1;
+		}
+		buf += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+/**
+ * Read one complete frame from the server
+ * @param buf  set to a malloc'd buffer holding the frame, NUL terminated, to
+ *             be freed by the caller
+ * @return 0 on success, -1 on error
+ */
+static int read_frame(int fd, char ** buf, struct psp_frame * frame)
+{
+	char head[PSP_HEADER_SIZE];
+
+	*buf = NULL;
+	if(read_all(fd, head, PSP_HEADER_SIZE))
+		return -1;
+	// the header tells us how much more to read
+	if(psp_parse_frame(head, PSP_HEADER_SIZE, frame) < 0)
+		return -1;
+	*buf = malloc(PSP_HEADER_SIZE + frame->length + 1);
+	memcpy(*buf, head, PSP_HEADER_SIZE);
+	if(read_all(fd, *buf + PSP_HEADER_SIZE, frame->length))
+	{
+		free(*buf);
+		*buf = NULL;
+		return -1;
+	}
+	(*buf)[PSP_HEADER_SIZE + frame->length] = '\0';
+	psp_parse_frame(*buf, PSP_HEADER_SIZE + frame->length, frame);
+	return 0;
+}
+
+/// The number of slots in the submission ring a client opens
+#define RING_SLOTS 64
+/// How many times a submitter polls for the server's answer before sleeping
+#define RING_SPINS 2000
+
+/// Picks the transport on the first job
+static pthread_once_t transport_once = PTHREAD_ONCE_INIT;
+
+/**
+ * The shared memory submission ring, set up on first use when
+ * PRINT_SERVER_TRANSPORT=shm.  While the ring is NULL every job goes over
+ * the socket.
+ */
+static struct
+{
+	struct psp_ring * ring;
+	size_t size;
+	// the connection that keeps the ring open on the server, and the
+	// eventfd that wakes the server
+	int fd;
+	int doorbell;
+	// where the next submission starts looking for a free slot
+	uint32_t next;
+} shm = { NULL, 0, -1, -1, 0 };
+
+/**
+ * The server's message queue, opened on first use when
+ * PRINT_SERVER_TRANSPORT=mq, and the largest message it takes.
+ */
+static struct
+{
+	mqd_t q;
+	long msgsize;
+} mq = { (mqd_t)-1, 0 };
+
+/**
+ * Read one frame from the server, along with a file descriptor passed with
+ * it
+ * @param pass_fd  set to the descriptor, or -1 if none came
+ * @return 0 on success, -1 on error
+ */
+static int read_frame_fd(int fd, char ** buf, struct psp_frame * frame, int * pass_fd)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	char head[PSP_HEADER_SIZE];
+	struct iovec iov = { head, PSP_HEADER_SIZE };
+	struct msghdr msg;
+	struct cmsghdr * cmsg;
+	ssize_t rc;
+
+	*pass_fd = -1;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	do {
+		rc = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_PEEK);
+	} while(rc == -1 && errno == EINTR);
+	if(rc <= 0)
+		return -1;
+	// the descriptor comes with the first byte; read_frame() takes the rest
+	for(cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(pass_fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+	if(read_frame(fd, buf, frame))
+	{
+		if(*pass_fd != -1)
+			close(*pass_fd);
+		*pass_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Open a submission ring with the server: a sealed memfd the server maps,
+ * traded over a connection that stays open for as long as the ring is used
+ * and which tells the server when the client has gone.
+ */
+static void open_ring()
+{
+	struct psp_ring * ring;
+	struct psp_frame frame;
+	struct psp_field field;
+	size_t size = sizeof(struct psp_ring) + RING_SLOTS * sizeof(struct psp_ring_slot);
+	char request[PSP_HEADER_SIZE];
+	char * reply;
+	uint32_t off = 0;
+	int status = -1;
+	int mfd, fd, doorbell;
+
+	mfd = memfd_create("print-server-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(mfd == -1)
+	{
+		perror("memfd_create");
+		return;
+	}
+	if(ftruncate(mfd, size) ||
+		fcntl(mfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) ||
+		(ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mfd, 0)) == MAP_FAILED)
+	{
+		perror("ring");
+		close(mfd);
+		return;
+	}
+	// a new memfd is zeroed, so every slot starts out free
+	ring->magic = PSP_RING_MAGIC;
+	ring->slots = RING_SLOTS;
+
+	psp_put_header(request, PSP_OPEN_RING, 0);
+	if((fd = connect_server()) == -1)
+	{
+		munmap(ring, size);
+		close(mfd);
+		return;
+	}
+	if(send_with_fd(fd, request, PSP_HEADER_SIZE, mfd) == 0 && read_frame_fd(fd, &reply, &frame, &doorbell) == 0)
+	{
+		while(psp_next_field(&frame, &off, &field) > 0)
+		{
+			if(field.tag == PSP_STATUS && field.length == 4)
+				status = (int32_t)psp_get_u32(field.data);
+		}
+		free(reply);
+		if(status == 0 && doorbell != -1)
+		{
+			close(mfd);
+			shm.ring = ring;
+			shm.size = size;
+			shm.fd = fd;
+			shm.doorbell = doorbell;
+			return;
+		}
+		if(doorbell != -1)
+			close(doorbell);
+	}
+	// the server would not have it; fall back to the socket
+	close(fd);
+	munmap(ring, size);
+	close(mfd);
+}
+
+/**
+ * Open the server's message queue, named by PRINT_SERVER_MQUEUE or the
+ * default.  Sends never block: a full queue sends the job over the socket.
+ */
+static void open_mqueue()
+{
+	const char * name = getenv("PRINT_SERVER_MQUEUE");
+	struct mq_attr attr;
+
+	mq.q = mq_open(name ? name : PSP_MQ_NAME, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if(mq.q == (mqd_t)-1)
+	{
+		perror("mq_open");
+		return;
+	}
+	if(mq_getattr(mq.q, &attr))
+	{
+		perror("mq_getattr");
+		mq_close(mq.q);
+		mq.q = (mqd_t)-1;
+		return;
+	}
+	mq.msgsize = attr.mq_msgsize;
+}
+
+/**
+ * Pick the transport named by PRINT_SERVER_TRANSPORT: shm for the shared
+ * memory ring, mq for the message queue, or the socket by default.
+ */
+static void open_transport()
+{
+	const char * transport = getenv("PRINT_SERVER_TRANSPORT");
+
+	if(transport == NULL)
+		return;
+	if(strcmp(transport, "shm") == 0)
+		open_ring();
+	else if(strcmp(transport, "mq") == 0)
+		open_mqueue();
+}
+
+/**
+ * Send a SUBMIT frame as a message on the server's queue, with the priority
+ * given by PRINT_SERVER_PRIORITY.  Nothing comes back, so the job is taken
+ * as accepted once the kernel has it.
+ * @return 0 if the job was queued, or -1 if it has to go over the socket
+ *         instead
+ */
+static int mq_submit(const char * request, size_t len)
+{
+	const char * value = getenv("PRINT_SERVER_PRIORITY");
+	long priority = value ? atol(value) : 0;
+
+	if(mq.q == (mqd_t)-1 || (long)len > mq.msgsize)
+		return -1;
+	if(priority < 0)
+		priority = 0;
+	if(priority >= sysconf(_SC_MQ_PRIO_MAX))
+		priority = sysconf(_SC_MQ_PRIO_MAX) - 1;
+	if(mq_send(mq.q, request, len, priority))
+	{
+		if(errno != EAGAIN)
+			perror("mq_send");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Submit a SUBMIT frame through the ring and wait for the server's answer.
+ * The server is only woken through the doorbell when it has said it is
+ * going to sleep; the answer is polled for a while and then waited on with
+ * a futex on the slot's state.
+ * @return 0 if the server answered, with status and handle filled in, or -1
+ *         if the job has to go over the socket instead
+ */
+static int ring_submit(const char * request, size_t len, int * status, int * handle)
+{
+	struct psp_ring * ring = __atomic_load_n(&shm.ring, __ATOMIC_ACQUIRE);
+	struct psp_ring_slot * slot = NULL;
+	struct timespec timeout = { 1, 0 };
+	struct pollfd hangup = { shm.fd, POLLIN, 0 };
+	uint64_t one = 1;
+	uint32_t expected, i, start;
+	int spins;
+
+	if(ring == NULL || len > PSP_RING_FRAME)
+		return -1;
+	// each submission starts looking for a free slot after the last one's,
+	// so threads of one client do not all fight over the first slot
+	start = __atomic_fetch_add(&shm.next, 1, __ATOMIC_RELAXED) % RING_SLOTS;
+	for(i = 0; i < RING_SLOTS && slot == NULL; i++)
+	{
+		expected = PSP_SLOT_FREE;
+		if(__atomic_compare_exchange_n(&ring->slot[(start + i) % RING_SLOTS].state, &expected,
+			PSP_SLOT_CLAIMED, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			slot = &ring->slot[(start + i) % RING_SLOTS];
+	}
+	if(slot == NULL)
+		return -1;
+
+	memcpy(slot->frame, request, len);
+	slot->length = len;
+	slot->waiting = 0;
+	__atomic_store_n(&slot->state, PSP_SLOT_SUBMITTED, __ATOMIC_SEQ_CST);
+	if(__atomic_exchange_n(&ring->asleep, 0, __ATOMIC_SEQ_CST))
+	{
+		if(write(shm.doorbell, &one, sizeof(one)) != sizeof(one))
+			perror("doorbell");
+	}
+
+	for(spins = 0; __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != PSP_SLOT_DONE; spins++)
+	{
+		if(spins < RING_SPINS)
+			continue;
+		__atomic_store_n(&slot->waiting, 1, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&slot->state, __ATOMIC_SEQ_CST) == PSP_SLOT_DONE)
+			break;
+		syscall(SYS_futex, &slot->state, FUTEX_WAIT, PSP_SLOT_SUBMITTED, &timeout, NULL, 0);
+		// a server that has gone away never answers; the ring is given up
+		// on, but left mapped as other threads may still be using it
+		if(__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != PSP_SLOT_DONE &&
+			poll(&hangup, 1, 0) == 1)
+		{
+			__atomic_store_n(&shm.ring, NULL, __ATOMIC_RELEASE);
+			*status = -1;
+			return 0;
+		}
+	}
+	*status = slot->status;
+	if(*status == 0 && handle)
+		*handle = (int)slot->handle;
+	__atomic_store_n(&slot->state, PSP_SLOT_FREE, __ATOMIC_RELEASE);
+	return 0;
+}
 
 /**
  * @brief     Send a print job to the print server daemon program.
  * @details   This function should send the given job to the print server program using
  *            your chosen method of IPC.
  * @param     handle
- *                 You may optionally implement this for extra credit.  If used this should return
- *                 a unique number that represents this print job and can be used to get information
- *                 about the job with other function calls.  If you choose not to implement this
- *                 you can safely ignore this param.
+ *                 Set to a unique number that represents this print job once the server has
+ *                 accepted it, for use with printer_is_finished() and printer_wait().  May be
+ *                 NULL.  Jobs sent through the message queue have no handle, and it is set
+ *                 to -1.
  * @param     driver
  *                 The name of the driver to print the job to.  Required.
  * @param     job_name
@@ -77,136 +504,224 @@ int printer_print(int* handle, char* driver, char* job_name, char* description,
 	*data = file_name_path e.g. /CprE308/Project2/Sample.ps
 	*/
 
-	struct sockaddr_un addr;
+	struct psp_frame frame;
+	struct psp_field field;
+	uint32_t length = 0;
+	uint32_t off = 0;
+	char * request;
+	char * reply;
+	char * path;
+	char * p;
+	int status = -1;
 	int fd;
-	int rc = 0;
-	char dataToSend[2048];
-
-	socket_path="../socket";
-
-	if ( (fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-		perror("socket error");
-		exit(-1);
-	}
-	memset(&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
-	if (*socket_path == '\0') {
-		*addr.sun_path = '\0';
-		strncpy(addr.sun_path+1, socket_path+1, sizeof(addr.sun_path)-2);
-	} else {
-		strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path)-1);
+	int file;
+
+	if(driver == NULL || job_name == NULL || data == NULL)
+		return -1;
+
+	pthread_once(&transport_once, open_transport);
+	path = realpath(data, NULL);
+	if(path == NULL)
+		path = strdup(data);
+	// jobs through the ring or the queue are opened by the server by path,
+	// and so are never passed a descriptor
+	if(__atomic_load_n(&shm.ring, __ATOMIC_ACQUIRE) || mq.q != (mqd_t)-1)
+	{
+		length = PSP_FIELD_HEADER_SIZE + strlen(driver) + PSP_FIELD_HEADER_SIZE + strlen(job_name) +
+			PSP_FIELD_HEADER_SIZE + strlen(path);
+		if(description)
+			length += PSP_FIELD_HEADER_SIZE + strlen(description);
+		if(length <= PSP_MAX_FRAME)
+		{
+			request = malloc(PSP_HEADER_SIZE + length);
+			p = psp_put_header(request, PSP_SUBMIT, length);
+			p = psp_put_field(p, PSP_PRINTER, driver, strlen(driver));
+			p = psp_put_field(p, PSP_NAME, job_name, strlen(job_name));
+			if(description)
+				p = psp_put_field(p, PSP_DESCRIPTION, description, strlen(description));
+			p = psp_put_field(p, PSP_FILE, path, strlen(path));
+			if(ring_submit(request, p - request, &status, handle) == 0)
+			{
+				free(request);
+				free(path);
+				return status;
+			}
+			if(mq_submit(request, p - request) == 0)
+			{
+				if(handle)
+					*handle = -1;
+				free(request);
+				free(path);
+				return 0;
+			}
+			free(request);
+		}
+		length = 0;
 	}
 
-	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
-		perror("client connect error");
-		exit(-1);
+	// the server prints from our open descriptor, so the job is exactly the
+	// file as it is now, whatever our working directory
+	file = open(data, O_RDONLY | O_CLOEXEC);
+	if(file == -1)
+	{
+		perror("open");
+		free(path);
+		return -1;
 	}
 
-/*	FILE * file;
-	char file_data[1024] = "";
-	file = fopen(data , "rb");
-	if (file) {
-		while (fscanf(file, "%s", buf)!=EOF){
-			strcat(file_data, buf);
-			strcat(file_data, " ");
-		}
-		strcat(file_data, "\0");
-		printf("What i read from the file: %s\n", file_data);
-		fclose(file);
-	}else{
-		printf("file open error\n");
-	}*/
-	strcat(dataToSend, "NEW\n");
-	strcat(dataToSend, "PRINTER: ");
-	strcat(dataToSend, driver);
-	strcat(dataToSend, "\n");
-	strcat(dataToSend, "NAME: ");
-	strcat(dataToSend, job_name);
-	strcat(dataToSend, "\n");
-	strcat(dataToSend, "DESCRIPTION: ");
-	strcat(dataToSend, description);
-	strcat(dataToSend, "\n");
-	strcat(dataToSend, "FILE: ");
-	strcat(dataToSend, data);
-	strcat(dataToSend, "\n");
-	strcat(dataToSend, "PRINT");
-	strcat(dataToSend, "\0");
-
-	rc=strlen(dataToSend);
-	if (write(fd, dataToSend, rc) != rc) {
-			if (rc > 0) fprintf(stderr,"partial write");
-			else {
-				perror("write error");
-				exit(-1);
-			}
+	// size the request: one field per piece of the job
+	length += PSP_FIELD_HEADER_SIZE + strlen(driver);
+	length += PSP_FIELD_HEADER_SIZE + strlen(job_name);
+	length += PSP_FIELD_HEADER_SIZE + strlen(path);
+	length += PSP_FIELD_HEADER_SIZE;
+	if(description)
+		length += PSP_FIELD_HEADER_SIZE + strlen(description);
+	if(length > PSP_MAX_FRAME)
+	{
+		free(path);
+		close(file);
+		return -1;
 	}
 
-
-/* THIS WAY DIDNT REALLY WORK TOO WELL
-	rc=strlen(driver);
-	write(fd, "PRINTER: ", 9);
-	if (write(fd, driver, rc) != rc) {
-			if (rc > 0) fprintf(stderr,"partial write");
-			else {
-				perror("write error");
-				exit(-1);
-			}
-	}
-	rc=strlen(job_name);
-	write(fd, "NAME: ", 6);
-	if (write(fd, job_name, rc) != rc) {
-			if (rc > 0) fprintf(stderr,"partial write");
-			else {
-				perror("write error");
-				exit(-1);
-			}
+	request = malloc(PSP_HEADER_SIZE + length);
+	p = psp_put_header(request, PSP_SUBMIT, length);
+	p = psp_put_field(p, PSP_PRINTER, driver, strlen(driver));
+	p = psp_put_field(p, PSP_NAME, job_name, strlen(job_name));
+	if(description)
+		p = psp_put_field(p, PSP_DESCRIPTION, description, strlen(description));
+	p = psp_put_field(p, PSP_FILE, path, strlen(path));
+	p = psp_put_field(p, PSP_FILE_FD, NULL, 0);
+	free(path);
+
+	if((fd = connect_server()) == -1)
+	{
+		free(request);
+		close(file);
+		return -1;
 	}
-	rc=strlen(description);
-	write(fd, "DESCRIPTION: ", 13);
-	if(description!=NULL){
-		if (write(fd, description, rc) != rc) {
-				if (rc > 0) fprintf(stderr,"partial write");
-				else {
-					perror("write error");
-					exit(-1);
-				}
-		}
-	}
-
-	rc=strlen(file_data);
-	write(fd, "FILE: ", 6);
-	if (write(fd, file_data, rc) != rc) {
-		if (rc > 0) fprintf(stderr,"partial write");
-		else {
-			perror("write error");
-			exit(-1);
+	if(send_with_fd(fd, request, p - request, file) == 0 && read_frame(fd, &reply, &frame) == 0)
+	{
+		// the server answers with whether it accepted the job, and the
+		// job's handle if it did
+		while(psp_next_field(&frame, &off, &field) > 0)
+		{
+			if(field.tag == PSP_STATUS && field.length == 4)
+				status = (int32_t)psp_get_u32(field.data);
+			else if(field.tag == PSP_HANDLE && field.length == 4 && handle)
+				*handle = (int)psp_get_u32(field.data);
 		}
+		free(reply);
 	}
-*/
-	/*
-	while( (rc=read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
-		if (write(fd, buf, rc) != rc) {
-			if (rc > 0) fprintf(stderr,"partial write");
-			else {
-				perror("write error");
-				exit(-1);
-			}
-		}
-	}*/
-	return 0;
+	close(fd);
+	close(file);
+	free(request);
+	return status;
 }
 
 //https://troydhanson.github.io/network/Unix_domain_sockets.html
 //http://man7.org/linux/man-pages/man7/unix.7.html
 
 
+/**
+ * Ask the server for its driver listing and turn it into a NULL terminated
+ * array.  The array, its drivers and their strings share one allocation.
+ * @param epoch    the epoch of the listing the caller has, or 0; set to the
+ *                 server's
+ * @param status   set to 1 if there is a new listing, 0 if it is still that
+ *                 of epoch, or -1 on error
+ * @return the array, or NULL if the listing is unchanged or on error
+ */
+static printer_driver_t ** fetch_drivers(uint32_t * epoch, int * number, int * status)
+{
+	struct psp_frame frame;
+	struct psp_field field;
+	char request[PSP_HEADER_SIZE + PSP_FIELD_HEADER_SIZE + 4];
+	char value[4];
+	char * reply = NULL;
+	const char * text = NULL;
+	uint32_t text_len = 0;
+	uint32_t count = 0;
+	uint32_t off = 0;
+	printer_driver_t ** list = NULL;
+	printer_driver_t * drivers;
+	char * line;
+	char * next;
+	int fd;
+	int i;
+
+	*status = -1;
+	if((fd = connect_server()) == -1)
+		return NULL;
+	psp_put_u32(value, *epoch);
+	psp_put_field(psp_put_header(request, PSP_LIST_DRIVERS, PSP_FIELD_HEADER_SIZE + 4), PSP_EPOCH, value, 4);
+	if(send_all(fd, request, sizeof(request)) || read_frame(fd, &reply, &frame) || frame.type != PSP_DRIVER_LIST)
+	{
+		free(reply);
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	while(psp_next_field(&frame, &off, &field) > 0)
+	{
+		if(field.tag == PSP_EPOCH && field.length == 4)
+			*epoch = psp_get_u32(field.data);
+		else if(field.tag == PSP_COUNT && field.length == 4)
+			count = psp_get_u32(field.data);
+		else if(field.tag == PSP_TEXT)
+		{
+			text = field.data;
+			text_len = field.length;
+		}
+	}
+	if(text == NULL)
+	{
+		*status = 0;
+		free(reply);
+		return NULL;
+	}
+	// there are never more lines than the text has bytes, whatever the
+	// count says
+	if(count > text_len)
+		count = text_len;
+
+	list = malloc((count + 1) * sizeof(printer_driver_t *) + count * sizeof(printer_driver_t) + text_len + 1);
+	if(list == NULL)
+	{
+		free(reply);
+		return NULL;
+	}
+	drivers = (printer_driver_t *)(list + count + 1);
+	line = (char *)(drivers + count);
+	memcpy(line, text, text_len);
+	line[text_len] = '\0';
+	free(reply);
+	for(i = 0; i < (int)count && *line; i++, line = next)
+	{
+		next = strchr(line, '\n');
+		if(next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+		drivers[i].printer_name = strsep(&line, "|");
+		drivers[i].driver_name = line ? line : "";
+		drivers[i].driver_version = "7";
+		list[i] = &drivers[i];
+	}
+	list[i] = NULL;
+	if(number)
+		*number = i;
+	*status = 1;
+	return list;
+}
+
 /**
  * @brief     List the currently installed printer drivers from the print server
  * @details   This function should query the print server for a list of currently installed drivers
  *            and return them as a NULL terminated array of printer_driver_t objects.
  * @param     number
  *                 Returns the number of printer drivers currently installed in the print server daemon
- * @return    An array of number printer_driver_t* objects followed by NULL
+ * @return    An array of number printer_driver_t* objects followed by NULL, to be freed by the
+ *            caller with a single free()
  * @example
  *
  * int num;
@@ -215,96 +730,106 @@ int printer_print(int* handle, char* driver, char* job_name, char* description,
  *
  */
 printer_driver_t** printer_list_drivers(int *number){
-	char buf[1024] = "";
-	struct sockaddr_un addr;
-	//char buf[1024];
-	int dataSock, ret;
-	int rc = 0;
-	char dataToSend[50] = "";
+	uint32_t epoch = 0;
+	int status;
 
-	socket_path="../socket";
+	return fetch_drivers(&epoch, number, &status);
+}
 
-	if ( (dataSock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-		perror("socket error");
-		exit(-1);
-	}
-	memset(&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
-	if (*socket_path == '\0') {
-		*addr.sun_path = '\0';
-		strncpy(addr.sun_path+1, socket_path+1, sizeof(addr.sun_path)-2);
-	} else {
-		strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path)-1);
-	}
+/**
+ * @brief     List the installed printer drivers if they have changed
+ * @details   The server versions its listing by an epoch that changes whenever a printer
+ *            is installed or uninstalled, and does not send a listing the caller already
+ *            has, so polling for changes is cheap.
+ * @param     epoch
+ *                 The epoch of the listing the caller has, or 0 for none.  Set to the
+ *                 server's epoch.
+ * @param     list
+ *                 Set to the new listing as returned by printer_list_drivers() if it has
+ *                 changed, or NULL if not.
+ * @param     number
+ *                 Set to the number of drivers in a new listing.
+ * @return    1 if the listing has changed, 0 if not, or < 0 if something goes wrong
+ */
+int printer_list_drivers_since(unsigned int *epoch, printer_driver_t*** list, int *number){
+	uint32_t e = *epoch;
+	int status;
 
-	if ((ret = connect(dataSock, (struct sockaddr*)&addr, sizeof(addr))) == -1) {
-		perror("client connect error");
-		exit(-1);
-	}
+	*list = fetch_drivers(&e, number, &status);
+	*epoch = e;
+	return status;
+}
 
-	strcat(dataToSend, "LIST_DRIVERS\0");
-	rc=strlen(dataToSend);
-	if (write(dataSock, dataToSend, rc) != rc) {
-			if (rc > 0) fprintf(stderr,"partial write");
-			else {
-				perror("write error");
-				exit(-1);
-			}
-	}
+/**
+ * Send a request and read the status the server answers with
+ * @return the status, or -1 on error
+ */
+static int request_status(const char * request, size_t len)
+{
+	struct psp_frame frame;
+	struct psp_field field;
+	char * reply;
+	uint32_t off = 0;
+	int status = -1;
+	int fd;
 
-	ret=read(dataSock,buf,sizeof(buf));
-	if(ret == -1){
-		perror("read");
-	}
-	close(dataSock);
-
-		//THERE'S LITERALLY NO INSTRUCTIONS ON HOW TO DO THIS PART
-		//SO HOPEFULLY THIS IS RIGHT
-
-	printer_driver_t * printlist = malloc(sizeof(printer_driver_t)*4);
-	char * line = NULL;
-	char * temp = NULL;
-	int i = 0;
-	temp = buf;
-	while((line = strsep(&temp, "\n"))!= NULL){
-		printf("%s\n", line);
-		printlist[i].printer_name = strsep(&line, "|");
-		printlist[i].driver_name = strsep(&line, "|");
-		printlist[i].driver_version = "7";
-		i++;
+	if((fd = connect_server()) == -1)
+		return -1;
+	if(send_all(fd, request, len) == 0 && read_frame(fd, &reply, &frame) == 0)
+	{
+		while(psp_next_field(&frame, &off, &field) > 0)
+		{
+			if(field.tag == PSP_STATUS && field.length == 4)
+				status = (int32_t)psp_get_u32(field.data);
+		}
+		free(reply);
 	}
-	i++;
-	printlist[i].printer_name = NULL;
-	printlist[i].driver_name = NULL;
-	printlist[i].driver_version = NULL;
-	printer_driver_t ** list = &printlist;
-	number = &i;
-
-	return list;
+	close(fd);
+	return status;
 }
 
-
-// Optional additional functions you may choose to implement for extra credit.
-#if 0
-
 /**
- * @brief     Install a new driver into the print server daemon.
- * @details   This function is used to hot-plug a new printer driver into the daemon at run time.
- * @param     driver_location
- *                 The file location of the printer driver (this will be in lab 7)
- * @param     driver
- *                 Details about the name and description of the driver.
- * @return    0 if successful, < 0 if something goes wrong.
+ * Send a request about one job
+ * @return the status the server answers with, or -1 on error
  */
-int printer_install_driver(char* driver_location, printer_driver_t driver);
+static int job_request(uint8_t type, int handle)
+{
+	char request[PSP_HEADER_SIZE + PSP_FIELD_HEADER_SIZE + 4];
+	char value[4];
+
+	if(handle < 0)
+		return -1;
+	psp_put_u32(value, handle);
+	psp_put_field(psp_put_header(request, type, PSP_FIELD_HEADER_SIZE + 4), PSP_HANDLE, value, 4);
+	return request_status(request, sizeof(request));
+}
 
 /**
- * @brief     Uninstall a currently installed printer driver.
- * @param     driver
- *                 The driver to uninstall
- * @return    0 if successful, < 0 if something goes wrong
+ * Send a request about one printer driver, naming its group if `group` is
+ * not NULL
+ * @return the status the server answers with, or -1 on error
  */
-int printer_uninstall_driver(printer_driver_t driver);
+static int driver_request(uint8_t type, const char * group, uint16_t tag, const char * value)
+{
+	size_t group_len = group ? strlen(group) : 0;
+	size_t value_len = strlen(value);
+	size_t length = PSP_FIELD_HEADER_SIZE + value_len;
+	char * request;
+	char * p;
+	int status;
+
+	if(group)
+		length += PSP_FIELD_HEADER_SIZE + group_len;
+	if(length > PSP_MAX_FRAME || (request = malloc(PSP_HEADER_SIZE + length)) == NULL)
+		return -1;
+	p = psp_put_header(request, type, length);
+	if(group)
+		p = psp_put_field(p, PSP_PRINTER, group, group_len);
+	psp_put_field(p, tag, value, value_len);
+	status = request_status(request, PSP_HEADER_SIZE + length);
+	free(request);
+	return status;
+}
 
 /**
  * @brief     Determine if a print job has finished yet
@@ -312,43 +837,115 @@ int printer_uninstall_driver(printer_driver_t driver);
  *                 The handle to the print job returned by printer_print() function
  * @return    1 if the job has finished, 0 if it has not finished, and < 0 is something goes wrong
  */
-int printer_is_finished(int handle);
+int printer_is_finished(int handle){
+	return job_request(PSP_JOB_STATUS, handle);
+}
 
 /**
  * @brief     Wait for a print job to finish printing before continuing
+ * @details   The server answers as soon as the printer reports the job done, there is
+ *            no polling.
  * @param     handle
  *                 The handle to the print job returned by printer_print() function
  * @return    0 if successful, < 0 if something goes wrong
  */
-int printer_wait(int handle)
- 
+int printer_wait(int handle){
+	return job_request(PSP_WAIT, handle);
+}
+
+/**
+ * @brief     Get the print server's statistics
+ * @return    The report as text, to be freed by the caller, or NULL on error
+ */
+char* printer_stats(void){
+	struct psp_frame frame;
+	struct psp_field field;
+	char request[PSP_HEADER_SIZE];
+	char * reply = NULL;
+	char * stats = NULL;
+	uint32_t off = 0;
+	int fd;
+
+	if((fd = connect_server()) == -1)
+		return NULL;
+
+	psp_put_header(request, PSP_STATS, 0);
+	if(send_all(fd, request, sizeof(request)) == 0 && read_frame(fd, &reply, &frame) == 0)
+	{
+		while(psp_next_field(&frame, &off, &field) > 0)
+		{
+			if(field.tag == PSP_TEXT && stats == NULL)
+				stats = strndup(field.data, field.length);
+		}
+		free(reply);
+	}
+	close(fd);
+	return stats;
+}
+
+
 /**
  * @brief     Cancel an already submitted job if it has not already been sent to the printer.
  * @param     handle
  *                 The handle to the print job returned by printer_print() function
- * @return    0 if the job was successfully canceled, > 1 if the job has already printed, 
- *            < 0 if something goes wrong
+ * @return    0 if the job was successfully canceled, 1 if the job has already been sent
+ *            to the printer, < 0 if something goes wrong
  */
-int printer_cancel_job(int handle);
+int printer_cancel_job(int handle){
+	return job_request(PSP_CANCEL, handle);
+}
 
 /**
  * @brief     Pause an already submitted job if it has not already been sent to the printer.
  * @param     handle
  *                 The handle to the print job returned by printer_print() function
- * @return    0 if the job was successfully paused, > 1 if the job has already printed,
- *            < 0 if something goes wrong.
+ * @return    0 if the job was successfully paused, 1 if the job has already been sent
+ *            to the printer, < 0 if something goes wrong.
  */
-int printer_pause_job(int handle);
+int printer_pause_job(int handle){
+	return job_request(PSP_PAUSE, handle);
+}
 
 /**
  * @brief     Resume printing a job that was paused
  * @param     handle
  *                 The handle to the print job returned by printer_print() function
- * @return    0 if the job was successfully resumed, < 0 if something goes wrong
+ * @return    0 if the job was successfully resumed, 1 if the job has already been sent
+ *            to the printer, < 0 if something goes wrong
  */
-int printer_resume_job(int handle);
+int printer_resume_job(int handle){
+	return job_request(PSP_RESUME, handle);
+}
 
-*/
-#endif
+/**
+ * @brief     Install a new driver into the print server daemon.
+ * @details   This function is used to hot-plug a new printer driver into the daemon at run time.
+ *            The driver must already be running; the new printer starts taking jobs from its
+ *            group straight away.
+ * @param     driver_location
+ *                 The file location of the printer driver, without the -r or -w, as seen from
+ *                 the print server's directory
+ * @param     driver
+ *                 The driver_name is the printer group the printer joins.
+ * @return    0 if successful, < 0 if something goes wrong.
+ */
+int printer_install_driver(char* driver_location, printer_driver_t driver){
+	if(driver_location == NULL || driver.driver_name == NULL)
+		return -1;
+	return driver_request(PSP_INSTALL_DRIVER, driver.driver_name, PSP_DRIVER, driver_location);
+}
+
+/**
+ * @brief     Uninstall a currently installed printer driver.
+ * @details   A printer that is printing a job finishes it before it is detached.
+ * @param     driver
+ *                 The driver to uninstall, as returned by printer_list_drivers().  The
+ *                 driver_name may be NULL to look for the printer in every group.
+ * @return    0 if successful, < 0 if something goes wrong
+ */
+int printer_uninstall_driver(printer_driver_t driver){
+	if(driver.printer_name == NULL)
+		return -1;
+	return driver_request(PSP_UNINSTALL_DRIVER, driver.driver_name, PSP_NAME, driver.printer_name);
+}
 
-#endif
@@ -37,10 +37,9 @@ struct PRINTER_DRIVER_STRUCT
  * @details   This function should send the given job to the print server program using
  *            your chosen method of IPC.
  * @param     handle
- *                 You may optionally implement this for extra credit.  If used this should return
- *                 a unique number that represents this print job and can be used to get information
- *                 about the job with other function calls.  If you choose not to implement this
- *                 you can safely ignore this param.
+ *                 Set to a unique number that represents this print job once the server has
+ *                 accepted it, for use with printer_is_finished() and printer_wait().  May be
+ *                 NULL.
  * @param     driver
  *                 The name of the driver to print the job to.  Required.
  * @param     job_name
@@ -64,7 +63,8 @@ int printer_print(int* handle, char* driver, char* job_name, char* description,
  *            and return them as a NULL terminated array of printer_driver_t objects.
  * @param     number
  *                 Returns the number of printer drivers currently installed in the print server daemon
- * @return    An array of number printer_driver_t* objects followed by NULL
+ * @return    An array of number printer_driver_t* objects followed by NULL, to be freed by the
+ *            caller with a single free()
  * @example
  *
  * int num;
@@ -74,28 +74,33 @@ int printer_print(int* handle, char* driver, char* job_name, char* description,
  */
 printer_driver_t** printer_list_drivers(int *number);
 
-
-// Optional additional functions you may choose to implement for extra credit.
-#if 0
-
 /**
- * @brief     Install a new driver into the print server daemon.
- * @details   This function is used to hot-plug a new printer driver into the daemon at run time.
- * @param     driver_location
- *                 The file location of the printer driver (this will be in lab 7)
- * @param     driver
- *                 Details about the name and description of the driver.
- * @return    0 if successful, < 0 if something goes wrong.
+ * @brief     List the installed printer drivers if they have changed
+ * @details   The server versions its listing by an epoch that changes whenever a printer
+ *            is installed or uninstalled, and does not send a listing the caller already
+ *            has, so polling for changes is cheap.
+ * @param     epoch
+ *                 The epoch of the listing the caller has, or 0 for none.  Set to the
+ *                 server's epoch.
+ * @param     list
+ *                 Set to the new listing as returned by printer_list_drivers() if it has
+ *                 changed, or NULL if not.
+ * @param     number
+ *                 Set to the number of drivers in a new listing.
+ * @return    1 if the listing has changed, 0 if not, or < 0 if something goes wrong
  */
-int printer_install_driver(char* driver_location, printer_driver_t driver);
+int printer_list_drivers_since(unsigned int *epoch, printer_driver_t*** list, int *number);
 
 /**
- * @brief     Uninstall a currently installed printer driver.
- * @param     driver
- *                 The driver to uninstall
- * @return    0 if successful, < 0 if something goes wrong
+ * @brief     Get the print server's statistics
+ * @details   For each printer group the report gives the queue depth, the enqueue and
+ *            dequeue rates since the previous request, and histograms of how long jobs
+ *            waited in the queue and took to print.  For each printer it gives the jobs
+ *            and bytes printed and the time spent printing.
+ * @return    The report as text, one group, printer or histogram per line, to be freed
+ *            by the caller.  NULL if something goes wrong.
  */
-int printer_uninstall_driver(printer_driver_t driver);
+char* printer_stats(void);
 
 /**
  * @brief     Determine if a print job has finished yet
@@ -111,14 +116,15 @@ int printer_is_finished(int handle);
  *                 The handle to the print job returned by printer_print() function
  * @return    0 if successful, < 0 if something goes wrong
  */
-int printer_wait(int handle)
- 
+int printer_wait(int handle);
+
+
 /**
  * @brief     Cancel an already submitted job if it has not already been sent to the printer.
  * @param     handle
  *                 The handle to the print job returned by printer_print() function
- * @return    0 if the job was successfully canceled, > 1 if the job has already printed, 
- *            < 0 if something goes wrong
+ * @return    0 if the job was successfully canceled, 1 if the job has already been sent
+ *            to the printer, < 0 if something goes wrong
  */
 int printer_cancel_job(int handle);
 
@@ -126,8 +132,8 @@ int printer_cancel_job(int handle);
  * @brief     Pause an already submitted job if it has not already been sent to the printer.
  * @param     handle
  *                 The handle to the print job returned by printer_print() function
- * @return    0 if the job was successfully paused, > 1 if the job has already printed,
- *            < 0 if something goes wrong.
+ * @return    0 if the job was successfully paused, 1 if the job has already been sent
+ *            to the printer, < 0 if something goes wrong.
  */
 int printer_pause_job(int handle);
 
@@ -135,11 +141,33 @@ int printer_pause_job(int handle);
  * @brief     Resume printing a job that was paused
  * @param     handle
  *                 The handle to the print job returned by printer_print() function
- * @return    0 if the job was successfully resumed, < 0 if something goes wrong
+ * @return    0 if the job was successfully resumed, 1 if the job has already been sent
+ *            to the printer, < 0 if something goes wrong
  */
 int printer_resume_job(int handle);
 
-*/
-#endif
+/**
+ * @brief     Install a new driver into the print server daemon.
+ * @details   This function is used to hot-plug a new printer driver into the daemon at run time.
+ *            The driver must already be running; the new printer starts taking jobs from its
+ *            group straight away.
+ * @param     driver_location
+ *                 The file location of the printer driver, without the -r or -w, as seen from
+ *                 the print server's directory
+ * @param     driver
+ *                 The driver_name is the printer group the printer joins.
+ * @return    0 if successful, < 0 if something goes wrong.
+ */
+int printer_install_driver(char* driver_location, printer_driver_t driver);
+
+/**
+ * @brief     Uninstall a currently installed printer driver.
+ * @details   A printer that is printing a job finishes it before it is detached.
+ * @param     driver
+ *                 The driver to uninstall, as returned by printer_list_drivers().  The
+ *                 driver_name may be NULL to look for the printer in every group.
+ * @return    0 if successful, < 0 if something goes wrong
+ */
+int printer_uninstall_driver(printer_driver_t driver);
 
 #endif
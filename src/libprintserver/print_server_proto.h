@@ -0,0 +1,324 @@
+/**
+ * @file      print_server_proto.h
+ * @date      2026-10-17: Created
+ * @brief     The binary wire protocol between libprintserver and the print server
+ * @copyright MIT License (c) 2015
+ *
+ * Every message is a frame made of a fixed header followed by `length` bytes
+ * of typed fields.  All integers are sent in network byte order.
+ *
+ *     frame:  magic(4) version(1) type(1) reserved(2) length(4) field...
+ *     field:  tag(2) reserved(2) length(4) data(length)
+ *
+ * String fields are not NUL terminated; the receiver uses the field length,
+ * so names and paths may be as long as the frame allows.  The first byte of
+ * the magic is not printable, which lets the server tell a binary client
+ * from one still speaking the old line based text format.
+ */
+
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#ifndef PRINT_SERVER_PROTO_H
+#define PRINT_SERVER_PROTO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+/// The first four bytes of every frame, "\x89PSP"
+#define PSP_MAGIC 0x89505350u
+/// The version of the protocol described here
+#define PSP_VERSION 1
+/// The size of a frame header
+#define PSP_HEADER_SIZE 12
+/// The size of a field header
+#define PSP_FIELD_HEADER_SIZE 8
+/// The largest frame body either side will accept
+#define PSP_MAX_FRAME (1024 * 1024)
+
+/// Frame types
+enum psp_type
+{
+	/// client: submit a print job
+	PSP_SUBMIT = 1,
+	/// client: ask for the installed printer drivers; given the EPOCH of a
+	/// listing it already has, the reply leaves out the TEXT if the listing
+	/// is still the same
+	PSP_LIST_DRIVERS = 2,
+	/// client: ask the server to shut down; like INSTALL_DRIVER and
+	/// UNINSTALL_DRIVER, only honoured for the server's user and root
+	PSP_EXIT = 3,
+	/// client: ask for the server's queue and printer statistics
+	PSP_STATS = 4,
+	/// client: ask whether the job with a HANDLE has finished, the RESULT
+	/// STATUS is 1 if it has, 0 if not and negative for an unknown handle
+	PSP_JOB_STATUS = 5,
+	/// client: wait for the job with a HANDLE to finish, the RESULT is sent
+	/// once it has, with a STATUS of 0 if it printed; a job that finished
+	/// too long ago to be remembered is answered as if it had failed
+	PSP_WAIT = 6,
+	/// client: cancel the job with a HANDLE, the RESULT STATUS is 0 if it was
+	/// cancelled, 1 if a printer already has it or it has finished, and
+	/// negative if the job belongs to another user
+	PSP_CANCEL = 7,
+	/// client: hold the job with a HANDLE back from the printers, the RESULT
+	/// STATUS is as for CANCEL
+	PSP_PAUSE = 8,
+	/// client: let a paused job with a HANDLE be printed again, the RESULT
+	/// STATUS is as for CANCEL, or negative if it could not be queued again
+	PSP_RESUME = 9,
+	/// client: install the printer driver running at a DRIVER location into
+	/// the group named by PRINTER
+	PSP_INSTALL_DRIVER = 10,
+	/// client: uninstall the printer with a NAME, from the group named by
+	/// PRINTER if one is given; the printer finishes its current job first
+	PSP_UNINSTALL_DRIVER = 11,
+	/// client: share a submission ring with the server, see struct psp_ring;
+	/// the memfd holding it is passed with SCM_RIGHTS alongside the first
+	/// byte of this frame, and the RESULT carries the ring's doorbell, an
+	/// eventfd, the same way
+	PSP_OPEN_RING = 12,
+	/// server: the result of a request
+	PSP_RESULT = 0x81,
+	/// server: the installed printer drivers, as the listing's EPOCH, the
+	/// COUNT of printers and a TEXT of one "name|group" line per printer
+	PSP_DRIVER_LIST = 0x82,
+	/// server: the statistics as key=value text, one group or printer per line
+	PSP_STATS_REPLY = 0x83,
+};
+
+/// Field tags
+enum psp_tag
+{
+	/// string: the printer group to print to
+	PSP_PRINTER = 1,
+	/// string: the name of the job, used as the output file name
+	PSP_NAME = 2,
+	/// string: a description of the job
+	PSP_DESCRIPTION = 3,
+	/// string: the path of the PostScript file
+	PSP_FILE = 4,
+	/// u32: the priority of the job
+	PSP_PRIORITY = 5,
+	/// u32: 0 on success, a negative number on failure
+	PSP_STATUS = 6,
+	/// string: free form text
+	PSP_TEXT = 7,
+	/// empty: the job file is open on a descriptor passed with SCM_RIGHTS
+	/// alongside the first byte of this frame
+	PSP_FILE_FD = 8,
+	/// u32: the handle of a job, its job number on the server
+	PSP_HANDLE = 9,
+	/// string: where a printer driver's fifos are, without the -r or -w
+	PSP_DRIVER = 10,
+	/// u32: the version of the driver listing, which changes whenever a
+	/// printer is installed or uninstalled; never 0
+	PSP_EPOCH = 11,
+	/// u32: a number of items
+	PSP_COUNT = 12,
+};
+
+/**
+ * A frame that has been fully received.  The body points into the receive
+ * buffer; nothing is copied.
+ */
+struct psp_frame
+{
+	uint8_t version;
+	uint8_t type;
+	uint32_t length;
+	const char * body;
+};
+
+/**
+ * One field of a frame, pointing into the frame body
+ */
+struct psp_field
+{
+	uint16_t tag;
+	uint32_t length;
+	const char * data;
+};
+
+static inline uint32_t psp_get_u32(const char * p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+static inline uint16_t psp_get_u16(const char * p)
+{
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohs(v);
+}
+
+static inline char * psp_put_u32(char * p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline char * psp_put_u16(char * p, uint16_t v)
+{
+	v = htons(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+/**
+ * Write a frame header
+ * @return a pointer just past the header, where the fields go
+ */
+static inline char * psp_put_header(char * p, uint8_t type, uint32_t length)
+{
+	p = psp_put_u32(p, PSP_MAGIC);
+	*p++ = PSP_VERSION;
+	*p++ = type;
+	p = psp_put_u16(p, 0);
+	return psp_put_u32(p, length);
+}
+
+/**
+ * Write a field
+ * @return a pointer just past the field
+ */
+static inline char * psp_put_field(char * p, uint16_t tag, const void * data, uint32_t length)
+{
+	p = psp_put_u16(p, tag);
+	p = psp_put_u16(p, 0);
+	p = psp_put_u32(p, length);
+	if(length)
+		memcpy(p, data, length);
+	return p + length;
+}
+
+/**
+ * Look for a complete frame at the start of a receive buffer
+ * @return the size of the frame if it is complete, 0 if more data is needed,
+ *         or -1 if the data is not a valid frame
+ */
+static inline long psp_parse_frame(const char * buf, size_t len, struct psp_frame * frame)
+{
+	if(len < PSP_HEADER_SIZE)
+		return 0;
+	if(psp_get_u32(buf) != PSP_MAGIC || (uint8_t)buf[4] != PSP_VERSION)
+		return -1;
+	frame->version = buf[4];
+	frame->type = buf[5];
+	frame->length = psp_get_u32(buf + 8);
+	if(frame->length > PSP_MAX_FRAME)
+		return -1;
+	if(len < PSP_HEADER_SIZE + (size_t)frame->length)
+		return 0;
+	frame->body = buf + PSP_HEADER_SIZE;
+	return PSP_HEADER_SIZE + frame->length;
+}
+
+/// The first four bytes of a submission ring, "PSPR"
+#define PSP_RING_MAGIC 0x50535052u
+/// The most slots a ring may have
+#define PSP_RING_MAX_SLOTS 1024
+/// The size of a ring slot, and of the largest frame it holds
+#define PSP_RING_SLOT_SIZE 4096
+#define PSP_RING_FRAME (PSP_RING_SLOT_SIZE - 32)
+
+/// The states of a ring slot
+enum psp_slot_state
+{
+	/// the slot may be claimed by any thread of the client
+	PSP_SLOT_FREE = 0,
+	/// a client thread is writing a frame into the slot
+	PSP_SLOT_CLAIMED = 1,
+	/// the frame is ready for the server
+	PSP_SLOT_SUBMITTED = 2,
+	/// the server has filled in the status and handle
+	PSP_SLOT_DONE = 3,
+};
+
+/**
+ * One slot of a submission ring.  The words shared by both sides are only
+ * touched with the __atomic builtins.
+ */
+struct psp_ring_slot
+{
+	// a psp_slot_state, and the futex a client sleeps on until DONE
+	uint32_t state;
+	// 1 while the client sleeps, so the server knows to wake it
+	uint32_t waiting;
+	// the size of the frame
+	uint32_t length;
+	// the result of a SUBMIT, as in a RESULT frame
+	int32_t status;
+	uint32_t handle;
+	uint32_t reserved[3];
+	char frame[PSP_RING_FRAME];
+};
+
+/**
+ * A submission ring shared by a client and the server on the same host, so
+ * in native byte order.  The client makes it in a memfd sealed against
+ * shrinking and opens it with OPEN_RING over a connection that it keeps
+ * open for as long as it uses the ring.  To submit a job the client copies
+ * a SUBMIT frame into a slot it claims and marks it SUBMITTED; it rings the
+ * doorbell only if it is the one to clear `asleep`, which the server sets
+ * before it waits for events.  The server writes the result and marks the
+ * slot DONE, waking the client with a futex if it is waiting.  A job
+ * submitted this way has its file opened by path on the server.
+ */
+struct psp_ring
+{
+	uint32_t magic;
+	// the number of slots that follow
+	uint32_t slots;
+	// 1 while the server may be asleep and needs the doorbell rung
+	uint32_t asleep;
+	uint32_t reserved[13];
+	struct psp_ring_slot slot[];
+};
+
+/// The default name of the message queue a server takes submissions from
+#define PSP_MQ_NAME "/print-server"
+/// The depth and message size a server asks for when it creates the queue
+#define PSP_MQ_DEPTH 64
+#define PSP_MQ_MSGSIZE 4096
+
+/*
+ * A client on the same host may also submit by sending a SUBMIT frame,
+ * without FILE_FD, as one message on the server's POSIX message queue.  The
+ * message priority is the job's priority.  Nothing is sent back: the job
+ * has no handle for the client, and a rejected job is only logged.  The
+ * queue is only open to the server's user, and its jobs are owned by that
+ * user and have their files opened by path.
+ */
+
+/**
+ * Step through the fields of a frame.  `offset` must start at 0.
+ * @return 1 if a field was found, 0 at the end of the frame, or -1 if the
+ *         frame is malformed
+ */
+static inline int psp_next_field(const struct psp_frame * frame, uint32_t * offset, struct psp_field * field)
+{
+	if(*offset == frame->length)
+		return 0;
+	if(frame->length - *offset < PSP_FIELD_HEADER_SIZE)
+		return -1;
+	field->tag = psp_get_u16(frame->body + *offset);
+	field->length = psp_get_u32(frame->body + *offset + 4);
+	if(field->length > frame->length - *offset - PSP_FIELD_HEADER_SIZE)
+		return -1;
+	field->data = frame->body + *offset + PSP_FIELD_HEADER_SIZE;
+	*offset += PSP_FIELD_HEADER_SIZE + field->length;
+	return 1;
+}
+
+#endif
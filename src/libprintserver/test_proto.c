@@ -0,0 +1,190 @@
+/**
+ * @file      test_proto.c
+ * @date      2026-10-17: Created
+ * @brief     Check the frame parser against well formed and malformed input
+ * @copyright MIT License (c) 2015, 2016
+ *
+ * Feeds psp_parse_frame() and psp_next_field() truncated, oversized and
+ * corrupted frames, then random bytes, and checks that every field they hand
+ * back lies inside the frame.  Build and run with `make check`; the exit
+ * status is non-zero if any check failed.
+ */
+
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "print_server_proto.h"
+
+/// The number of random frames thrown at the parser
+#define RANDOM_FRAMES 100000
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+/**
+ * Build a SUBMIT frame with a printer and a file name field
+ * @return the size of the frame
+ */
+static size_t make_frame(char * buf)
+{
+	char * p = buf + PSP_HEADER_SIZE;
+
+	p = psp_put_field(p, PSP_PRINTER, "color", 5);
+	p = psp_put_field(p, PSP_FILE, "", 0);
+	p = psp_put_field(p, PSP_NAME, "out.pdf", 7);
+	psp_put_header(buf, PSP_SUBMIT, p - buf - PSP_HEADER_SIZE);
+	return p - buf;
+}
+
+static void check_headers()
+{
+	struct psp_frame frame;
+	char buf[256];
+	size_t len = make_frame(buf);
+	size_t i;
+
+	CHECK(psp_parse_frame(buf, len, &frame) == (long)len);
+	CHECK(frame.type == PSP_SUBMIT);
+	CHECK(frame.length == len - PSP_HEADER_SIZE);
+	CHECK(frame.body == buf + PSP_HEADER_SIZE);
+
+	// every prefix of a good frame asks for more data
+	for(i = 0; i < len; i++)
+		CHECK(psp_parse_frame(buf, i, &frame) == 0);
+	// data after the frame belongs to the next one
+	memset(buf + len, 0xff, 16);
+	CHECK(psp_parse_frame(buf, len + 16, &frame) == (long)len);
+
+	// a wrong magic or version is refused as soon as the header is in
+	buf[0] ^= 1;
+	CHECK(psp_parse_frame(buf, PSP_HEADER_SIZE, &frame) == -1);
+	buf[0] ^= 1;
+	buf[4] = PSP_VERSION + 1;
+	CHECK(psp_parse_frame(buf, len, &frame) == -1);
+	buf[4] = PSP_VERSION;
+
+	// so is a frame longer than a client may send, before it is received
+	psp_put_header(buf, PSP_SUBMIT, PSP_MAX_FRAME + 1);
+	CHECK(psp_parse_frame(buf, PSP_HEADER_SIZE, &frame) == -1);
+	psp_put_header(buf, PSP_SUBMIT, 0xffffffffu);
+	CHECK(psp_parse_frame(buf, PSP_HEADER_SIZE, &frame) == -1);
+	psp_put_header(buf, PSP_SUBMIT, PSP_MAX_FRAME);
+	CHECK(psp_parse_frame(buf, PSP_HEADER_SIZE, &frame) == 0);
+
+	// an empty body is a complete frame with no fields
+	psp_put_header(buf, PSP_EXIT, 0);
+	CHECK(psp_parse_frame(buf, PSP_HEADER_SIZE, &frame) == PSP_HEADER_SIZE);
+}
+
+static void check_fields()
+{
+	struct psp_frame frame;
+	struct psp_field field;
+	char buf[256];
+	size_t len = make_frame(buf);
+	uint32_t off = 0;
+
+	CHECK(psp_parse_frame(buf, len, &frame) == (long)len);
+	CHECK(psp_next_field(&frame, &off, &field) == 1);
+	CHECK(field.tag == PSP_PRINTER && field.length == 5 && memcmp(field.data, "color", 5) == 0);
+	CHECK(psp_next_field(&frame, &off, &field) == 1);
+	CHECK(field.tag == PSP_FILE && field.length == 0);
+	CHECK(psp_next_field(&frame, &off, &field) == 1);
+	CHECK(field.tag == PSP_NAME && field.length == 7 && memcmp(field.data, "out.pdf", 7) == 0);
+	CHECK(psp_next_field(&frame, &off, &field) == 0);
+	CHECK(off == frame.length);
+
+	// a body that ends part way through a field header
+	frame.length = PSP_FIELD_HEADER_SIZE - 1;
+	off = 0;
+	CHECK(psp_next_field(&frame, &off, &field) == -1);
+
+	// a body that ends part way through a field's data
+	frame.length = PSP_FIELD_HEADER_SIZE + 4;
+	off = 0;
+	CHECK(psp_next_field(&frame, &off, &field) == -1);
+
+	// field lengths that would run past the body, or wrap around
+	frame.length = len - PSP_HEADER_SIZE;
+	psp_put_u32(buf + PSP_HEADER_SIZE + 4, frame.length);
+	off = 0;
+	CHECK(psp_next_field(&frame, &off, &field) == -1);
+	psp_put_u32(buf + PSP_HEADER_SIZE + 4, 0xffffffffu);
+	off = 0;
+	CHECK(psp_next_field(&frame, &off, &field) == -1);
+	psp_put_u32(buf + PSP_HEADER_SIZE + 4, 0xffffffffu - PSP_FIELD_HEADER_SIZE + 1);
+	off = 0;
+	CHECK(psp_next_field(&frame, &off, &field) == -1);
+}
+
+/**
+ * Random bytes behind a good header must only ever give fields inside the
+ * frame, and the walk must end.
+ */
+static void check_random()
+{
+	struct psp_frame frame;
+	struct psp_field field;
+	char buf[PSP_HEADER_SIZE + 64];
+	uint32_t off, length;
+	int i, rv, fields;
+	size_t j;
+
+	srand(308);
+	for(i = 0; i < RANDOM_FRAMES; i++)
+	{
+		length = rand() % 65;
+		for(j = 0; j < sizeof(buf); j++)
+			buf[j] = rand();
+		// small field lengths turn up far more often than chance would have
+		if(length >= PSP_FIELD_HEADER_SIZE && rand() % 2)
+			psp_put_u32(buf + PSP_HEADER_SIZE + 4, rand() % length);
+		psp_put_header(buf, rand(), length);
+		if(psp_parse_frame(buf, PSP_HEADER_SIZE + length, &frame) != PSP_HEADER_SIZE + length)
+		{
+			CHECK(0);
+			continue;
+		}
+		off = 0;
+		fields = 0;
+		while((rv = psp_next_field(&frame, &off, &field)) > 0)
+		{
+			CHECK(field.data >= frame.body && field.data + field.length <= frame.body + frame.length);
+			CHECK(off <= frame.length);
+			CHECK(++fields <= (int)(length / PSP_FIELD_HEADER_SIZE));
+			if(fields > (int)(length / PSP_FIELD_HEADER_SIZE))
+				break;
+		}
+		CHECK(rv <= 0);
+	}
+}
+
+int main()
+{
+	check_headers();
+	check_fields();
+	check_random();
+	if(failures)
+	{
+		fprintf(stderr, "test_proto: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("test_proto: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file      job_index.c
+ * @date      2026-10-17: Created
+ * @brief     Unfinished print jobs found by their job number
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdlib.h>
+
+#include "job_index.h"
+
+/// The number of entries in a new index
+#define JOB_INDEX_INITIAL 1024
+
+/**
+ * Hash a job number into the job index (Fibonacci hashing)
+ */
+static size_t hash_job(long long job_number)
+{
+	return (size_t)((unsigned long long)job_number * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+/**
+ * Add a queued job to the job index, growing the index so it is never more
+ * than half full.  The job number is passed apart from the job because a
+ * printer may already have recycled the job.
+ * @return 0 on success, or -1 if the index could not grow, in which case it
+ *         is left as it was
+ */
+int job_index_insert(struct job_index * index, long long job_number, struct print_job * job)
+{
+	struct job_entry * old = index->entries;
+	struct job_entry * e;
+	size_t old_size = old ? index->mask + 1 : 0;
+	size_t size, h, i;
+
+	if(2 * (index->count + 1) > old_size)
+	{
+		size = old_size ? 2 * old_size : JOB_INDEX_INITIAL;
+		e = malloc(size * sizeof(struct job_entry));
+		if(e == NULL)
+			return -1;
+		for(i = 0; i < size; i++)
+			e[i].job_number = -1;
+		for(i = 0; i < old_size; i++)
+		{
+			if(old[i].job_number == -1)
+				continue;
+			for(h = hash_job(old[i].job_number); e[h & (size - 1)].job_number != -1; h++);
+			e[h & (size - 1)] = old[i];
+		}
+		free(old);
+		index->entries = e;
+		index->mask = size - 1;
+	}
+	for(h = hash_job(job_number); index->entries[h & index->mask].job_number != -1; h++);
+	e = &index->entries[h & index->mask];
+	e->job_number = job_number;
+	e->job = job;
+	e->waiters = NULL;
+	index->count++;
+	return 0;
+}
+
+/**
+ * Look up an unfinished job by its handle.
+ * @return the job's entry, or NULL if the job has finished
+ */
+struct job_entry * job_index_find(struct job_index * index, long long job_number)
+{
+	struct job_entry * e;
+	size_t h;
+
+	if(index->entries == NULL)
+		return NULL;
+	for(h = hash_job(job_number); (e = &index->entries[h & index->mask])->job_number != -1; h++)
+	{
+		if(e->job_number == job_number)
+			return e;
+	}
+	return NULL;
+}
+
+/**
+ * Take a finished job out of the job index.  Later entries in the same run
+ * are shifted back so lookups never stop at the hole.
+ */
+void job_index_remove(struct job_index * index, struct job_entry * e)
+{
+	size_t i = e - index->entries;
+	size_t j = i;
+	size_t home;
+
+	while(1)
+	{
+		j = (j + 1) & index->mask;
+		if(index->entries[j].job_number == -1)
+			break;
+		home = hash_job(index->entries[j].job_number) & index->mask;
+		// leave entries whose home lies cyclically in (i, j]
+		if(i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		index->entries[i] = index->entries[j];
+		i = j;
+	}
+	index->entries[i].job_number = -1;
+	index->count--;
+}
+
+/**
+ * Free the index.  The jobs and waiters of entries still in it are left to
+ * the caller.
+ */
+void job_index_destroy(struct job_index * index)
+{
+	free(index->entries);
+	index->entries = NULL;
+	index->mask = 0;
+	index->count = 0;
+}
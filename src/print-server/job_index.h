@@ -0,0 +1,68 @@
+/**
+ * @file      job_index.h
+ * @date      2026-10-17: Created
+ * @brief     Unfinished print jobs found by their job number
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#ifndef JOB_INDEX_H
+#define JOB_INDEX_H
+
+#include <stddef.h>
+#include "print_job.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+struct connection;
+
+/**
+ * A job that has been queued and has not finished yet, found by its handle
+ */
+struct job_entry
+{
+	// the job number, which is the handle given to the client; -1 if free
+	long long job_number;
+	// the job itself, which is recycled once a printer is done with it, so
+	// its job number must match before it is touched
+	struct print_job * job;
+	// the clients waiting for the job to finish
+	struct connection * waiters;
+};
+
+/**
+ * An open addressed hash table of jobs by job number, a power of two in size
+ * and never more than half full.  It is not thread safe; an entry found in
+ * it may move when a job is added or removed.
+ */
+struct job_index
+{
+	struct job_entry * entries;
+	size_t mask;
+	size_t count;
+};
+
+// add a job, growing the index if need be; 0 on success, -1 if out of memory
+int job_index_insert(struct job_index * index, long long job_number, struct print_job * job);
+// the entry of a job, or NULL if it is not in the index
+struct job_entry * job_index_find(struct job_index * index, long long job_number);
+// take an entry found by job_index_find out of the index
+void job_index_remove(struct job_index * index, struct job_entry * e);
+// free the index, the jobs still in it are left to the caller
+void job_index_destroy(struct job_index * index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,289 @@
+/**
+ * @file      job_log.c
+ * @date      2026-10-17: Created
+ * @brief     An append-only job log written in the background
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+#include "job_log.h"
+
+/**
+ * One buffered line.  The sequence number says whether the slot is free for
+ * a producer or holds a line for the writer, as in the job ring.
+ */
+struct log_slot
+{
+	atomic_size_t seq;
+	char line[JOB_LOG_LINE];
+};
+
+/**
+ * The state of the job log.  Any thread may add lines; only the writer
+ * thread touches the file.
+ */
+static struct
+{
+	struct job_log_config config;
+	// the buffered lines, a power of two of them
+	struct log_slot * slots;
+	size_t mask;
+	// the next slot to be filled by a producer
+	_Alignas(64) atomic_size_t head;
+	// the next slot to be written out, only used by the writer
+	_Alignas(64) size_t tail;
+	// the number of lines dropped because the buffer was full
+	atomic_size_t dropped;
+	// the open log file and its size
+	int fd;
+	size_t size;
+	// the log was moved aside but a new one could not be created yet
+	int reopen;
+	// wakes the writer early when the log is closed
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int closing;
+} job_log = { .fd = -1 };
+
+/**
+ * Move the current log to path.1, shifting older logs up and dropping the
+ * oldest, then start a new log.  If the new log cannot be created the lines
+ * go on to the old one, and only the create is tried again at the next flush.
+ */
+static void rotate(void)
+{
+	char from[1024];
+	char to[1024];
+	int i;
+	int fd;
+
+	if(!job_log.reopen)
+	{
+		for(i = job_log.config.keep; i > 0; i--)
+		{
+			if(i > 1)
+				snprintf(from, sizeof(from), "%s.%d", job_log.config.path, i - 1);
+			else
+				snprintf(from, sizeof(from), "%s", job_log.config.path);
+			snprintf(to, sizeof(to), "%s.%d", job_log.config.path, i);
+			rename(from, to);
+		}
+		if(job_log.config.keep == 0)
+			unlink(job_log.config.path);
+	}
+	fd = open(job_log.config.path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if(fd == -1)
+	{
+		if(!job_log.reopen)
+			eprintf("Failed to start a new job log %s: %s\n", job_log.config.path, strerror(errno));
+		job_log.reopen = 1;
+		return;
+	}
+	close(job_log.fd);
+	job_log.fd = fd;
+	job_log.size = 0;
+	job_log.reopen = 0;
+}
+
+/**
+ * Write every line that is ready to the log file.
+ */
+static void flush_lines(void)
+{
+	char buf[64 * 1024];
+	struct log_slot * slot;
+	size_t len = 0;
+	size_t n;
+	size_t dropped;
+
+	while(1)
+	{
+		slot = &job_log.slots[job_log.tail & job_log.mask];
+		if(atomic_load_explicit(&slot->seq, memory_order_acquire) != job_log.tail + 1)
+			break;
+		n = strlen(slot->line);
+		if(len + n > sizeof(buf))
+		{
+			if(write(job_log.fd, buf, len) > 0)
+				job_log.size += len;
+			len = 0;
+		}
+		memcpy(buf + len, slot->line, n);
+		len += n;
+		// hand the slot back to the producers
+		atomic_store_explicit(&slot->seq, job_log.tail + job_log.mask + 1, memory_order_release);
+		job_log.tail++;
+	}
+
+	dropped = atomic_exchange(&job_log.dropped, 0);
+	if(dropped && len + 64 <= sizeof(buf))
+		len += snprintf(buf + len, 64, "-- %zu log lines dropped --\n", dropped);
+	if(len && write(job_log.fd, buf, len) > 0)
+		job_log.size += len;
+
+	if(job_log.config.rotate_bytes && job_log.size >= job_log.config.rotate_bytes)
+		rotate();
+}
+
+/**
+ * The writer thread: write out the buffered lines once per flush interval.
+ */
+static void * writer_thread(void * arg)
+{
+	struct timespec ts;
+	int closing = 0;
+
+	while(!closing)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += job_log.config.flush_ms / 1000;
+		ts.tv_nsec += (job_log.config.flush_ms % 1000) * 1000000L;
+		if(ts.tv_nsec >= 1000000000L)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_mutex_lock(&job_log.lock);
+		while(!job_log.closing && pthread_cond_timedwait(&job_log.cond, &job_log.lock, &ts) != ETIMEDOUT);
+		closing = job_log.closing;
+		pthread_mutex_unlock(&job_log.lock);
+
+		flush_lines();
+	}
+	return NULL;
+}
+
+int job_log_open(const struct job_log_config * config)
+{
+	pthread_condattr_t attr;
+	struct stat st;
+	size_t size = 1;
+	size_t i;
+
+	job_log.config = *config;
+	if(job_log.config.flush_ms <= 0)
+		job_log.config.flush_ms = 1000;
+	while(size < (job_log.config.lines ? job_log.config.lines : 4096))
+		size <<= 1;
+	job_log.slots = malloc(size * sizeof(struct log_slot));
+	if(job_log.slots == NULL)
+		return -1;
+	job_log.mask = size - 1;
+	for(i = 0; i < size; i++)
+		atomic_init(&job_log.slots[i].seq, i);
+	atomic_init(&job_log.head, 0);
+	atomic_init(&job_log.dropped, 0);
+	job_log.tail = 0;
+
+	job_log.fd = open(job_log.config.path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if(job_log.fd == -1)
+	{
+		eprintf("Failed to open job log %s\n", job_log.config.path);
+		free(job_log.slots);
+		return -1;
+	}
+	job_log.size = fstat(job_log.fd, &st) == 0 ? st.st_size : 0;
+	job_log.reopen = 0;
+
+	pthread_mutex_init(&job_log.lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&job_log.cond, &attr);
+	pthread_condattr_destroy(&attr);
+	job_log.closing = 0;
+	if(pthread_create(&job_log.tid, NULL, writer_thread, NULL))
+	{
+		close(job_log.fd);
+		job_log.fd = -1;
+		free(job_log.slots);
+		return -1;
+	}
+	return 0;
+}
+
+void job_log_printf(const char * fmt, ...)
+{
+	struct log_slot * slot;
+	struct timespec now;
+	size_t pos;
+	intptr_t diff;
+	va_list ap;
+	int n;
+
+	if(job_log.fd == -1)
+		return;
+
+	// claim a free slot, or give up straight away if the buffer is full
+	pos = atomic_load_explicit(&job_log.head, memory_order_relaxed);
+	while(1)
+	{
+		slot = &job_log.slots[pos & job_log.mask];
+		diff = (intptr_t)atomic_load_explicit(&slot->seq, memory_order_acquire) - (intptr_t)pos;
+		if(diff == 0)
+		{
+			if(atomic_compare_exchange_weak_explicit(&job_log.head, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if(diff < 0)
+		{
+			atomic_fetch_add(&job_log.dropped, 1);
+			return;
+		}
+		else
+		{
+			pos = atomic_load_explicit(&job_log.head, memory_order_relaxed);
+		}
+	}
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	n = snprintf(slot->line, JOB_LOG_LINE, "%ld.%03ld ", (long)now.tv_sec, now.tv_nsec / 1000000L);
+	va_start(ap, fmt);
+	n += vsnprintf(slot->line + n, JOB_LOG_LINE - n, fmt, ap);
+	va_end(ap);
+	// every entry is a line of its own, even if it had to be cut short
+	if(n >= JOB_LOG_LINE - 1)
+		n = JOB_LOG_LINE - 2;
+	slot->line[n] = '\n';
+	slot->line[n + 1] = '\0';
+
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+void job_log_close(void)
+{
+	if(job_log.fd == -1)
+		return;
+	pthread_mutex_lock(&job_log.lock);
+	job_log.closing = 1;
+	pthread_cond_signal(&job_log.cond);
+	pthread_mutex_unlock(&job_log.lock);
+	pthread_join(job_log.tid, NULL);
+	close(job_log.fd);
+	job_log.fd = -1;
+	free(job_log.slots);
+}
+
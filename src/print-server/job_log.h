@@ -0,0 +1,58 @@
+/**
+ * @file      job_log.h
+ * @date      2026-10-17: Created
+ * @brief     An append-only job log written in the background
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#ifndef JOB_LOG_H
+#define JOB_LOG_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+/**
+ * Settings for the job log, read from config.rc
+ */
+struct job_log_config
+{
+	// the file the log is appended to
+	const char * path;
+	// how often buffered lines are written out, in milliseconds
+	int flush_ms;
+	// the size at which the log is rotated to path.1, path.2, ...
+	size_t rotate_bytes;
+	// the number of rotated logs to keep
+	int keep;
+	// the number of lines buffered in memory
+	size_t lines;
+};
+
+/// The longest line the log will keep, longer lines are truncated
+#define JOB_LOG_LINE 512
+
+// open the log and start the thread that writes it
+int job_log_open(const struct job_log_config * config);
+// add a line to the log, never blocks; the line is dropped if the buffer is full
+void job_log_printf(const char * fmt, ...) __attribute__ ((format (printf, 1, 2)));
+// write out everything buffered, stop the writer thread and close the log
+void job_log_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
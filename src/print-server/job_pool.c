@@ -0,0 +1,217 @@
+/**
+ * @file      job_pool.c
+ * @date      2026-10-17: Created
+ * @brief     Recycled storage for print jobs and their strings
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "job_pool.h"
+
+/// The number of job slots carved from one slab
+#define JOBS_PER_SLAB 64
+/// The smallest overflow string block, strings that fit inline never get one
+#define MIN_STRING_SHIFT 8
+/// The number of overflow size classes, from 256 bytes to 1 MB
+#define STRING_CLASSES 13
+/// The size of the chunks overflow blocks are carved from
+#define STRING_CHUNK (1024 * 1024)
+
+/**
+ * The header in front of every overflow string block.  Free blocks are
+ * chained through it, blocks in use remember their size class.
+ */
+union string_block
+{
+	union string_block * next;
+	size_t size_class;
+	// keep the string that follows suitably aligned
+	max_align_t align;
+};
+
+/**
+ * The pool shared by the main thread, which builds jobs, and the printer
+ * threads, which finish them.  Nothing is ever handed back to malloc, so
+ * once the pool has grown to the peak number of jobs in flight it stays
+ * that size.
+ */
+static struct
+{
+	pthread_mutex_t lock;
+	// free job slots, chained through next_job
+	struct print_job * free_jobs;
+	// free overflow blocks by size class
+	union string_block * free_strings[STRING_CLASSES];
+	// the unused end of the current overflow chunk
+	char * chunk;
+	size_t chunk_left;
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * Carve a new slab of job slots onto the free list.  Called with the lock
+ * held.
+ */
+static int grow_jobs(void)
+{
+	struct print_job * slab;
+	int i;
+
+	slab = malloc(JOBS_PER_SLAB * sizeof(struct print_job));
+	if(slab == NULL)
+		return -1;
+	for(i = 0; i < JOBS_PER_SLAB; i++)
+	{
+		slab[i].next_job = pool.free_jobs;
+		pool.free_jobs = &slab[i];
+	}
+	return 0;
+}
+
+struct print_job * job_pool_alloc(void)
+{
+	struct print_job * job;
+
+	pthread_mutex_lock(&pool.lock);
+	if(pool.free_jobs == NULL && grow_jobs())
+	{
+		pthread_mutex_unlock(&pool.lock);
+		return NULL;
+	}
+	job = pool.free_jobs;
+	pool.free_jobs = job->next_job;
+	pthread_mutex_unlock(&pool.lock);
+
+	// only the fixed part is cleared, the inline strings are overwritten
+	memset(job, 0, offsetof(struct print_job, strings));
+	job->group = -1;
+	job->fd = -1;
+	return job;
+}
+
+/**
+ * Take an overflow block big enough for size bytes.  Blocks larger than
+ * the biggest class come straight from malloc.
+ */
+static char * alloc_string(size_t size)
+{
+	union string_block * b;
+	size_t c = 0;
+	size_t bytes;
+
+	while(c < STRING_CLASSES && ((size_t)1 << (MIN_STRING_SHIFT + c)) < size + sizeof(*b))
+		c++;
+	if(c == STRING_CLASSES)
+	{
+		b = malloc(sizeof(*b) + size);
+		if(b == NULL)
+			return NULL;
+		b->size_class = c;
+		return (char*)(b + 1);
+	}
+	bytes = (size_t)1 << (MIN_STRING_SHIFT + c);
+
+	pthread_mutex_lock(&pool.lock);
+	b = pool.free_strings[c];
+	if(b)
+	{
+		pool.free_strings[c] = b->next;
+	}
+	else
+	{
+		if(pool.chunk_left < bytes)
+		{
+			// the tail of the old chunk is given up, at most one block's worth
+			pool.chunk = malloc(STRING_CHUNK);
+			pool.chunk_left = pool.chunk ? STRING_CHUNK : 0;
+		}
+		if(pool.chunk_left >= bytes)
+		{
+			b = (union string_block*)pool.chunk;
+			pool.chunk += bytes;
+			pool.chunk_left -= bytes;
+		}
+	}
+	pthread_mutex_unlock(&pool.lock);
+	if(b == NULL)
+		return NULL;
+	b->size_class = c;
+	return (char*)(b + 1);
+}
+
+/**
+ * Give back a string, unless it lives in the job's inline storage.
+ */
+static void free_string(struct print_job * job, char * s)
+{
+	union string_block * b;
+	size_t c;
+
+	if(s == NULL || (s >= job->strings && s < job->strings + sizeof(job->strings)))
+		return;
+	b = (union string_block*)s - 1;
+	c = b->size_class;
+	if(c == STRING_CLASSES)
+	{
+		free(b);
+		return;
+	}
+	pthread_mutex_lock(&pool.lock);
+	b->next = pool.free_strings[c];
+	pool.free_strings[c] = b;
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * Short strings are packed into the job itself; longer ones get a block
+ * from the pool.  Setting a field again releases its old block, though any
+ * inline space it used is not reused until the job is recycled.
+ * @return the copy, or NULL if out of memory
+ */
+char * job_pool_set_string(struct print_job * job, char ** field, const char * s, size_t len)
+{
+	char * copy;
+
+	free_string(job, *field);
+	if(len < sizeof(job->strings) - job->strings_used)
+	{
+		copy = job->strings + job->strings_used;
+		job->strings_used += len + 1;
+	}
+	else
+	{
+		copy = alloc_string(len + 1);
+	}
+	if(copy)
+	{
+		memcpy(copy, s, len);
+		copy[len] = '\0';
+	}
+	*field = copy;
+	return copy;
+}
+
+void job_pool_free(struct print_job * job)
+{
+	free_string(job, job->file_name);
+	free_string(job, job->job_name);
+	free_string(job, job->description);
+
+	pthread_mutex_lock(&pool.lock);
+	job->next_job = pool.free_jobs;
+	pool.free_jobs = job;
+	pthread_mutex_unlock(&pool.lock);
+}
+
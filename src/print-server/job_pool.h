@@ -0,0 +1,39 @@
+/**
+ * @file      job_pool.h
+ * @date      2026-10-17: Created
+ * @brief     Recycled storage for print jobs and their strings
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <stddef.h>
+#include "print_job.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+// take a cleared job from the pool, with no group and no file descriptor
+struct print_job * job_pool_alloc(void);
+// set one of the job's strings to a copy of the first len bytes of s
+char * job_pool_set_string(struct print_job * job, char ** field, const char * s, size_t len);
+// return a job and its strings to the pool, the caller closes job->fd
+void job_pool_free(struct print_job * job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
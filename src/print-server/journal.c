@@ -0,0 +1,674 @@
+/**
+ * @file      journal.c
+ * @date      2026-10-17: Created
+ * @brief     A write-ahead journal of print jobs that survives a restart
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+#include "job_pool.h"
+#include "journal.h"
+
+/// The first bytes of a journal file
+#define JOURNAL_MAGIC "PSJRNL01"
+/// The size of the file header, records start after it; the magic is
+/// followed by the next job number, so a number dropped by compaction is
+/// never handed out again
+#define JOURNAL_HEADER 16
+/// The size a new journal file starts at, it doubles as it fills
+#define JOURNAL_INITIAL (1024 * 1024)
+/// The address space reserved for the mapping, so growing never moves it
+#define JOURNAL_RESERVE ((size_t)4 << 30)
+
+/// Record types
+enum
+{
+	RECORD_SUBMITTED = 1,
+	RECORD_DISPATCHED = 2,
+	RECORD_FINISHED = 3,
+};
+
+/**
+ * The header of every record.  Records are padded to a multiple of 8 bytes
+ * and the check covers everything after it, so a record torn by a crash is
+ * recognised and the replay stops there.
+ */
+struct record
+{
+	uint32_t length;
+	uint32_t check;
+	uint32_t type;
+	uint32_t reserved;
+	int64_t job_number;
+};
+
+/**
+ * What follows the header of a submitted record, then the strings
+ * themselves in the same order as their lengths.
+ */
+struct submitted
+{
+	int32_t priority;
+	uint32_t owner;
+	int64_t size;
+	// group, job name, description, file name
+	uint32_t lengths[4];
+};
+
+/**
+ * A submitted record found while scanning the journal
+ */
+struct live_job
+{
+	int64_t job_number;
+	size_t offset;
+	int finished;
+};
+
+/**
+ * The open journal.  Appends from any thread are copied into the mapping
+ * under the lock; the committer thread makes them durable in batches, and
+ * compacts the journal when an append finds it has grown too large.
+ */
+static struct
+{
+	char * path;
+	// where a compacted journal is written before it replaces the journal
+	char * new_path;
+	int fd;
+	char * base;
+	// the size of the file, and the end of the last record in it
+	size_t size;
+	size_t written;
+	// how much of the file is known to be on disk
+	size_t synced;
+	// the journal is compacted when it grows past this
+	size_t compact_at;
+	size_t compact_bytes;
+	// one past the highest job number submitted to the journal
+	int64_t next_job_number;
+	// an append asked the committer to compact the journal
+	int compacting;
+	int closing;
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} journal = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+/**
+ * FNV-1a over a range of bytes
+ */
+static uint32_t checksum(const char * p, size_t len)
+{
+	uint32_t h = 2166136261u;
+	while(len--)
+	{
+		h ^= (unsigned char)*p++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Check the record at off, if there is one.
+ * @return the length of the record, or 0 if the journal ends here
+ */
+static size_t valid_record(const char * base, size_t size, size_t off)
+{
+	struct record r;
+
+	if(size - off < sizeof(r))
+		return 0;
+	memcpy(&r, base + off, sizeof(r));
+	if(r.length < sizeof(r) || r.length % 8 || r.length > size - off)
+		return 0;
+	if(checksum(base + off + 8, r.length - 8) != r.check)
+		return 0;
+	return r.length;
+}
+
+/**
+ * Find a job in the scanned jobs.  Job numbers only go up through the
+ * journal, so the jobs are already sorted.
+ */
+static struct live_job * find_job(struct live_job * jobs, size_t n, int64_t job_number)
+{
+	size_t lo = 0, hi = n, mid;
+
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if(jobs[mid].job_number < job_number)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < n && jobs[lo].job_number == job_number ? &jobs[lo] : NULL;
+}
+
+/**
+ * Walk the records of a journal and collect the jobs that were submitted
+ * and never finished.
+ * @param end set to the end of the last good record
+ * @return the number of unfinished jobs, or -1 if out of memory
+ */
+static long scan(const char * base, size_t size, struct live_job ** out, size_t * end)
+{
+	struct live_job * jobs = NULL;
+	struct live_job * j;
+	struct record r;
+	size_t n = 0, cap = 0, i, k;
+	size_t off = JOURNAL_HEADER;
+	size_t len;
+
+	while((len = valid_record(base, size, off)))
+	{
+		memcpy(&r, base + off, sizeof(r));
+		if(r.type == RECORD_SUBMITTED && (n == 0 || r.job_number > jobs[n-1].job_number))
+		{
+			if(n == cap)
+			{
+				cap = cap ? cap * 2 : 1024;
+				j = realloc(jobs, cap * sizeof(*jobs));
+				if(j == NULL)
+				{
+					free(jobs);
+					return -1;
+				}
+				jobs = j;
+			}
+			jobs[n].job_number = r.job_number;
+			jobs[n].offset = off;
+			jobs[n].finished = 0;
+			n++;
+		}
+		else if(r.type == RECORD_FINISHED && (j = find_job(jobs, n, r.job_number)))
+		{
+			j->finished = 1;
+		}
+		off += len;
+	}
+	*end = off;
+
+	for(i = k = 0; i < n; i++)
+	{
+		if(!jobs[i].finished)
+			jobs[k++] = jobs[i];
+	}
+	*out = jobs;
+	return k;
+}
+
+/**
+ * Open and map a journal file, creating it if need be.
+ * @return 0 on success, or -1 on error
+ */
+static int map_file(const char * path, int flags, int * fd, char ** base, size_t * size)
+{
+	struct stat st;
+
+	*fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | flags, 0644);
+	if(*fd == -1)
+		return -1;
+	if(fstat(*fd, &st) == -1)
+		goto fail;
+	*size = st.st_size;
+	if(*size < JOURNAL_INITIAL)
+	{
+		*size = JOURNAL_INITIAL;
+		if(ftruncate(*fd, *size) == -1)
+			goto fail;
+	}
+	*base = mmap(NULL, JOURNAL_RESERVE, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if(*base == MAP_FAILED)
+		goto fail;
+	if(memcmp(*base, JOURNAL_MAGIC, 8) != 0)
+	{
+		// a new file, or one with no header we recognise
+		memset(*base, 0, JOURNAL_HEADER);
+		memcpy(*base, JOURNAL_MAGIC, 8);
+	}
+	return 0;
+
+fail:
+	close(*fd);
+	return -1;
+}
+
+/**
+ * Write the submitted records of unfinished jobs, found by scan() in the
+ * journal mapped at from, and the next job number to a new file next to the
+ * journal.  The new file
+ * is not in place until install() is called.
+ * @param off set to the end of the last record written
+ * @return 0 on success, or -1 on error
+ */
+static int compact(const char * from, const struct live_job * jobs, size_t n, int64_t next_job_number, int * fd, char ** base, size_t * size, size_t * off)
+{
+	size_t need, len, i;
+
+	need = JOURNAL_HEADER;
+	for(i = 0; i < n; i++)
+		need += ((struct record*)(from + jobs[i].offset))->length;
+
+	if(map_file(journal.new_path, O_TRUNC, fd, base, size))
+		return -1;
+	while(*size < 2 * need)
+		*size *= 2;
+	if(ftruncate(*fd, *size) == -1)
+	{
+		munmap(*base, JOURNAL_RESERVE);
+		close(*fd);
+		unlink(journal.new_path);
+		return -1;
+	}
+
+	memcpy(*base + 8, &next_job_number, sizeof(next_job_number));
+	*off = JOURNAL_HEADER;
+	for(i = 0; i < n; i++)
+	{
+		len = ((struct record*)(from + jobs[i].offset))->length;
+		memcpy(*base + *off, from + jobs[i].offset, len);
+		*off += len;
+	}
+	return 0;
+}
+
+/**
+ * Copy the records of the running journal between two offsets to the end of
+ * a compacted file, growing it if need be.
+ * @return 0 on success, or -1 on error
+ */
+static int copy_tail(int fd, char * base, size_t * size, size_t * off, size_t from, size_t to)
+{
+	size_t grown = *size;
+
+	while(grown < *off + (to - from))
+		grown *= 2;
+	if(grown != *size)
+	{
+		if(grown > JOURNAL_RESERVE || ftruncate(fd, grown) == -1)
+			return -1;
+		*size = grown;
+	}
+	memcpy(base + *off, journal.base + from, to - from);
+	*off += to - from;
+	return 0;
+}
+
+/**
+ * Put a compacted file in place of the journal.  The first synced bytes of
+ * it must already be on disk.
+ * @return 0 on success, or -1 if the old journal was kept
+ */
+static int install(int fd, char * base, size_t size, size_t written, size_t synced)
+{
+	if(rename(journal.new_path, journal.path) == -1)
+		return -1;
+	if(journal.fd != -1)
+	{
+		munmap(journal.base, JOURNAL_RESERVE);
+		close(journal.fd);
+	}
+	journal.fd = fd;
+	journal.base = base;
+	journal.size = size;
+	journal.written = written;
+	journal.synced = synced;
+	journal.compact_at = 2 * written > journal.compact_bytes ? 2 * written : journal.compact_bytes;
+	return 0;
+}
+
+/**
+ * Compact the journal while it is running.  Called by the committer with the
+ * lock held, which is only taken back to look at what was appended meanwhile
+ * and, at the end, to copy the last few records and swap the files.  The
+ * records up to journal.written are never changed once appended, and the
+ * mapping never moves, so they are read with the lock released.
+ */
+static void compact_running(void)
+{
+	struct live_job * jobs = NULL;
+	char * base;
+	size_t size, off, end, scanned, caught_up, synced;
+	int64_t next_job_number;
+	long n;
+	int fd;
+
+	end = journal.written;
+	next_job_number = journal.next_job_number;
+	pthread_mutex_unlock(&journal.lock);
+
+	n = scan(journal.base, end, &jobs, &scanned);
+	if(n < 0 || compact(journal.base, jobs, n, next_job_number, &fd, &base, &size, &off))
+	{
+		pthread_mutex_lock(&journal.lock);
+		goto failed;
+	}
+
+	// catch up with the records appended during the scan and make the
+	// whole file durable before it can replace the journal
+	pthread_mutex_lock(&journal.lock);
+	caught_up = journal.written;
+	pthread_mutex_unlock(&journal.lock);
+	if(copy_tail(fd, base, &size, &off, end, caught_up) || fdatasync(fd) == -1)
+	{
+		pthread_mutex_lock(&journal.lock);
+		goto discard;
+	}
+	synced = off;
+
+	// the records appended since are few; they are left for the next
+	// fdatasync() like any other fresh record
+	pthread_mutex_lock(&journal.lock);
+	if(copy_tail(fd, base, &size, &off, caught_up, journal.written) == 0
+		&& install(fd, base, size, off, synced) == 0)
+	{
+		journal.compacting = 0;
+		free(jobs);
+		return;
+	}
+
+discard:
+	munmap(base, JOURNAL_RESERVE);
+	close(fd);
+	unlink(journal.new_path);
+failed:
+	eprintf("Failed to compact the journal\n");
+	// try again once it has grown as much again
+	journal.compact_at = 2 * journal.written;
+	journal.compacting = 0;
+	free(jobs);
+}
+
+/**
+ * The committer thread.  Each fdatasync() covers every record appended while
+ * the previous one was running, so a burst of submissions shares one flush.
+ * Compaction is done here too, so no append ever waits for it.
+ */
+static void * committer_thread(void * arg)
+{
+	size_t target;
+	int fd;
+
+	pthread_mutex_lock(&journal.lock);
+	while(1)
+	{
+		while(!journal.closing && !journal.compacting && journal.synced == journal.written)
+			pthread_cond_wait(&journal.cond, &journal.lock);
+		if(journal.compacting && !journal.closing)
+		{
+			compact_running();
+			continue;
+		}
+		if(journal.synced == journal.written)
+			break;
+		target = journal.written;
+		fd = journal.fd;
+		pthread_mutex_unlock(&journal.lock);
+
+		if(fdatasync(fd) == -1)
+			perror("fdatasync");
+
+		// only this thread swaps the file, so fd is still the journal
+		pthread_mutex_lock(&journal.lock);
+		if(target > journal.synced)
+			journal.synced = target;
+		pthread_cond_broadcast(&journal.cond);
+	}
+	pthread_mutex_unlock(&journal.lock);
+	return NULL;
+}
+
+/**
+ * Append one record made of a header and up to five pieces of payload.
+ */
+static void append(uint32_t type, int64_t job_number, const void * const * parts, const size_t * lengths, int count)
+{
+	struct record r;
+	size_t len = sizeof(r);
+	size_t size;
+	char * p;
+	int i;
+
+	if(journal.fd == -1)
+		return;
+	for(i = 0; i < count; i++)
+		len += lengths[i];
+	len = (len + 7) & ~(size_t)7;
+
+	pthread_mutex_lock(&journal.lock);
+	if(type == RECORD_SUBMITTED && job_number >= journal.next_job_number)
+		journal.next_job_number = job_number + 1;
+	// the committer compacts the journal, appends carry on meanwhile
+	if(journal.written + len > journal.compact_at)
+		journal.compacting = 1;
+	if(journal.written + len > journal.size)
+	{
+		for(size = journal.size; size < journal.written + len; size *= 2);
+		if(size > JOURNAL_RESERVE || ftruncate(journal.fd, size) == -1)
+		{
+			pthread_mutex_unlock(&journal.lock);
+			eprintf("Journal is full, job %lld not recorded\n", (long long)job_number);
+			return;
+		}
+		journal.size = size;
+	}
+
+	p = journal.base + journal.written;
+	r.length = len;
+	r.type = type;
+	r.reserved = 0;
+	r.job_number = job_number;
+	memcpy(p, &r, sizeof(r));
+	p += sizeof(r);
+	for(i = 0; i < count; i++)
+	{
+		memcpy(p, parts[i], lengths[i]);
+		p += lengths[i];
+	}
+	memset(p, 0, journal.base + journal.written + len - p);
+	r.check = checksum(journal.base + journal.written + 8, len - 8);
+	memcpy(journal.base + journal.written + 4, &r.check, sizeof(r.check));
+	journal.written += len;
+
+	pthread_cond_broadcast(&journal.cond);
+	pthread_mutex_unlock(&journal.lock);
+}
+
+void journal_submitted(const struct print_job * job, const char * group)
+{
+	struct submitted s;
+	const void * parts[5];
+	size_t lengths[5];
+	const char * strings[4] = { group, job->job_name, job->description, job->file_name };
+	int i;
+
+	s.priority = job->priority;
+	s.owner = job->owner;
+	s.size = job->size;
+	parts[0] = &s;
+	lengths[0] = sizeof(s);
+	for(i = 0; i < 4; i++)
+	{
+		parts[i+1] = strings[i] ? strings[i] : "";
+		lengths[i+1] = strlen(parts[i+1]);
+		s.lengths[i] = lengths[i+1];
+	}
+	append(RECORD_SUBMITTED, job->job_number, parts, lengths, 5);
+}
+
+void journal_dispatched(long long job_number)
+{
+	append(RECORD_DISPATCHED, job_number, NULL, NULL, 0);
+}
+
+void journal_finished(long long job_number)
+{
+	append(RECORD_FINISHED, job_number, NULL, NULL, 0);
+}
+
+/**
+ * Rebuild a job from its submitted record.
+ */
+static struct print_job * load_job(const char * p, const char ** group, size_t * group_len)
+{
+	struct record r;
+	struct submitted s;
+	struct print_job * job;
+
+	memcpy(&r, p, sizeof(r));
+	memcpy(&s, p + sizeof(r), sizeof(s));
+	p += sizeof(r) + sizeof(s);
+	if(sizeof(r) + sizeof(s) + (size_t)s.lengths[0] + s.lengths[1] + s.lengths[2] + s.lengths[3] > r.length)
+		return NULL;
+
+	job = job_pool_alloc();
+	if(job == NULL)
+		return NULL;
+	job->job_number = r.job_number;
+	job->priority = s.priority;
+	job->owner = s.owner;
+	job->size = s.size;
+	*group = p;
+	*group_len = s.lengths[0];
+	p += s.lengths[0];
+	if(s.lengths[1])
+		job_pool_set_string(job, &job->job_name, p, s.lengths[1]);
+	p += s.lengths[1];
+	if(s.lengths[2])
+		job_pool_set_string(job, &job->description, p, s.lengths[2]);
+	p += s.lengths[2];
+	job_pool_set_string(job, &job->file_name, p, s.lengths[3]);
+	return job;
+}
+
+int journal_open(const char * path, size_t compact_bytes, journal_recover_fn recover, void * arg, long long * next_job_number)
+{
+	struct live_job * jobs;
+	struct print_job * job;
+	const char * group;
+	size_t group_len, end, size, new_size, off, i, k;
+	char * base;
+	char * new_base;
+	int64_t next;
+	long n;
+	int fd, new_fd;
+
+	journal.path = strdup(path);
+	journal.new_path = malloc(strlen(path) + 5);
+	if(journal.path == NULL || journal.new_path == NULL)
+		return -1;
+	sprintf(journal.new_path, "%s.new", path);
+	journal.compact_bytes = compact_bytes;
+	if(map_file(path, 0, &fd, &base, &size))
+	{
+		eprintf("Failed to open journal %s\n", path);
+		return -1;
+	}
+	n = scan(base, size, &jobs, &end);
+	if(n < 0)
+	{
+		munmap(base, JOURNAL_RESERVE);
+		close(fd);
+		return -1;
+	}
+	journal.base = base;
+
+	// jobs are handed back in the order they were submitted; a job the
+	// server no longer takes is left out of the compacted journal
+	for(i = k = 0; i < (size_t)n; i++)
+	{
+		job = load_job(base + jobs[i].offset, &group, &group_len);
+		if(job && recover(job, group, group_len, arg) == 0)
+			jobs[k++] = jobs[i];
+	}
+	memcpy(&next, base + 8, sizeof(next));
+	if(next > *next_job_number)
+		*next_job_number = next;
+	for(i = JOURNAL_HEADER; i < end; i += ((struct record*)(base + i))->length)
+	{
+		if(((struct record*)(base + i))->job_number >= *next_job_number)
+			*next_job_number = ((struct record*)(base + i))->job_number + 1;
+	}
+	journal.next_job_number = *next_job_number;
+	dprintf("Recovered %zu of %ld unfinished jobs from %s\n", k, n, path);
+
+	// start again from a journal holding only the recovered jobs
+	if(compact(base, jobs, k, journal.next_job_number, &new_fd, &new_base, &new_size, &off))
+	{
+		new_fd = -1;
+	}
+	else if(fdatasync(new_fd) == -1 || install(new_fd, new_base, new_size, off, off))
+	{
+		munmap(new_base, JOURNAL_RESERVE);
+		close(new_fd);
+		unlink(journal.new_path);
+		new_fd = -1;
+	}
+	if(new_fd == -1)
+	{
+		eprintf("Failed to compact journal %s\n", path);
+		memcpy(base + 8, &journal.next_job_number, sizeof(journal.next_job_number));
+		journal.fd = fd;
+		journal.size = size;
+		journal.written = journal.synced = end;
+		journal.compact_at = 2 * end > compact_bytes ? 2 * end : compact_bytes;
+	}
+	else
+	{
+		munmap(base, JOURNAL_RESERVE);
+		close(fd);
+	}
+	free(jobs);
+
+	if(pthread_create(&journal.tid, NULL, committer_thread, NULL))
+	{
+		munmap(journal.base, JOURNAL_RESERVE);
+		close(journal.fd);
+		journal.fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+void journal_close(void)
+{
+	if(journal.fd == -1)
+		return;
+	pthread_mutex_lock(&journal.lock);
+	journal.closing = 1;
+	pthread_cond_broadcast(&journal.cond);
+	pthread_mutex_unlock(&journal.lock);
+	pthread_join(journal.tid, NULL);
+	munmap(journal.base, JOURNAL_RESERVE);
+	close(journal.fd);
+	journal.fd = -1;
+	// ready to be opened again
+	journal.closing = 0;
+	journal.compacting = 0;
+	free(journal.path);
+	free(journal.new_path);
+	journal.path = journal.new_path = NULL;
+}
+
@@ -0,0 +1,51 @@
+/**
+ * @file      journal.h
+ * @date      2026-10-17: Created
+ * @brief     A write-ahead journal of print jobs that survives a restart
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include "print_job.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+/**
+ * Called for each job still unfinished when the journal is opened.  The job
+ * comes from the job pool with its group left unset; the callback owns it
+ * from then on.
+ * @return 0 if the job was queued again, or -1 if it was dropped
+ */
+typedef int (*journal_recover_fn)(struct print_job * job, const char * group, size_t group_len, void * arg);
+
+// replay and compact the journal at path, then start logging to it
+int journal_open(const char * path, size_t compact_bytes, journal_recover_fn recover, void * arg, long long * next_job_number);
+// record that a job has been accepted into a group's queue
+void journal_submitted(const struct print_job * job, const char * group);
+// record that a printer has started on a job
+void journal_dispatched(long long job_number);
+// record that a job is done with, printed or not
+void journal_finished(long long job_number);
+// make everything durable and close the journal
+void journal_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,499 @@
+/**
+ * @file      output_cache.c
+ * @date      2026-10-17: Created
+ * @brief     A bounded LRU cache of printed output keyed by job content
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "debug.h"
+#include "output_cache.h"
+
+/// The size of the buffer a job's file is read into to be hashed
+#define HASH_CHUNK (64 * 1024)
+
+/**
+ * A SHA-256 computation in progress (FIPS 180-4)
+ */
+struct sha256
+{
+	uint32_t state[8];
+	uint64_t length;
+	unsigned char block[64];
+	size_t used;
+};
+
+/**
+ * One cached output.  Entries are found through a chained hash table and
+ * kept in a list from the most to the least recently used.
+ */
+struct cache_entry
+{
+	unsigned char key[OUTPUT_CACHE_KEY];
+	off_t size;
+	struct cache_entry * newer;
+	struct cache_entry * older;
+	struct cache_entry * chain;
+};
+
+/**
+ * The cache, shared by every printer thread under the lock.  The files are
+ * only copied with the lock released.
+ */
+static struct
+{
+	pthread_mutex_t lock;
+	char * path;
+	size_t max_bytes;
+	size_t max_entries;
+	size_t bytes;
+	size_t entries;
+	struct cache_entry ** buckets;
+	size_t mask;
+	struct cache_entry * newest;
+	struct cache_entry * oldest;
+} cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_init(struct sha256 * s)
+{
+	static const uint32_t initial[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memcpy(s->state, initial, sizeof(initial));
+	s->length = 0;
+	s->used = 0;
+}
+
+static void sha256_block(struct sha256 * s, const unsigned char * p)
+{
+	uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	for(i = 0; i < 16; i++)
+		w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+	for(; i < 64; i++)
+		w[i] = w[i - 16] + (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3))
+			+ w[i - 7] + (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	a = s->state[0]; b = s->state[1]; c = s->state[2]; d = s->state[3];
+	e = s->state[4]; f = s->state[5]; g = s->state[6]; h = s->state[7];
+	for(i = 0; i < 64; i++)
+	{
+		t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	s->state[0] += a; s->state[1] += b; s->state[2] += c; s->state[3] += d;
+	s->state[4] += e; s->state[5] += f; s->state[6] += g; s->state[7] += h;
+}
+
+static void sha256_update(struct sha256 * s, const void * data, size_t len)
+{
+	const unsigned char * p = data;
+	size_t n;
+
+	s->length += len;
+	while(len)
+	{
+		n = 64 - s->used < len ? 64 - s->used : len;
+		memcpy(s->block + s->used, p, n);
+		s->used += n;
+		p += n;
+		len -= n;
+		if(s->used == 64)
+		{
+			sha256_block(s, s->block);
+			s->used = 0;
+		}
+	}
+}
+
+static void sha256_final(struct sha256 * s, unsigned char digest[32])
+{
+	uint64_t bits = s->length * 8;
+	unsigned char pad = 0x80;
+	unsigned char length[8];
+	int i;
+
+	sha256_update(s, &pad, 1);
+	pad = 0;
+	while(s->used != 56)
+		sha256_update(s, &pad, 1);
+	for(i = 0; i < 8; i++)
+		length[i] = bits >> (56 - 8 * i);
+	sha256_update(s, length, 8);
+	for(i = 0; i < 8; i++)
+	{
+		digest[4 * i] = s->state[i] >> 24;
+		digest[4 * i + 1] = s->state[i] >> 16;
+		digest[4 * i + 2] = s->state[i] >> 8;
+		digest[4 * i + 3] = s->state[i];
+	}
+}
+
+/**
+ * The file a key is cached in, named by the key in hex
+ */
+static void entry_path(char * name, size_t size, const unsigned char key[OUTPUT_CACHE_KEY])
+{
+	int i, n;
+
+	n = snprintf(name, size, "%s/", cache.path);
+	for(i = 0; i < OUTPUT_CACHE_KEY && n + 2 < (int)size; i++)
+		n += sprintf(name + n, "%02x", key[i]);
+}
+
+/**
+ * Whether a file name is one the cache made, or a copy it left unfinished
+ */
+static int is_entry_name(const char * name)
+{
+	int i;
+
+	for(i = 0; i < 2 * OUTPUT_CACHE_KEY; i++)
+	{
+		if(!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f')))
+			return 0;
+	}
+	return name[i] == '\0' || strncmp(name + i, ".cache-tmp.", 11) == 0;
+}
+
+/**
+ * Make path a copy of an open file: a reflink where the filesystem shares
+ * blocks, a copy in the kernel otherwise.  The copy is made under a unique
+ * temporary name and renamed, so no one sees half of it and two copies to
+ * the same path cannot write into each other.
+ * @return 0 on success, or -1 on error
+ */
+static int clone_file(int in, const char * path)
+{
+	char tmp[4096];
+	struct stat st;
+	off_t offset = 0;
+	ssize_t n;
+	int out;
+
+	if(fstat(in, &st))
+		return -1;
+	if(snprintf(tmp, sizeof(tmp), "%s.cache-tmp.XXXXXX", path) >= (int)sizeof(tmp))
+		return -1;
+	out = mkostemp(tmp, O_CLOEXEC);
+	if(out == -1)
+		return -1;
+	if(fchmod(out, 0644))
+	{
+		close(out);
+		unlink(tmp);
+		return -1;
+	}
+	if(ioctl(out, FICLONE, in) != 0)
+	{
+		while(offset < st.st_size)
+		{
+			n = copy_file_range(in, &offset, out, NULL, st.st_size - offset, 0);
+			if(n <= 0)
+			{
+				if(n == -1 && errno == EINTR)
+					continue;
+				close(out);
+				unlink(tmp);
+				return -1;
+			}
+		}
+	}
+	if(close(out) || rename(tmp, path))
+	{
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+static struct cache_entry ** find_entry(const unsigned char key[OUTPUT_CACHE_KEY])
+{
+	struct cache_entry ** e;
+	size_t h;
+
+	memcpy(&h, key, sizeof(h));
+	for(e = &cache.buckets[h & cache.mask]; *e; e = &(*e)->chain)
+	{
+		if(memcmp((*e)->key, key, OUTPUT_CACHE_KEY) == 0)
+			break;
+	}
+	return e;
+}
+
+static void unlink_lru(struct cache_entry * e)
+{
+	if(e->newer)
+		e->newer->older = e->older;
+	else
+		cache.newest = e->older;
+	if(e->older)
+		e->older->newer = e->newer;
+	else
+		cache.oldest = e->newer;
+}
+
+static void push_lru(struct cache_entry * e)
+{
+	e->newer = NULL;
+	e->older = cache.newest;
+	if(cache.newest)
+		cache.newest->newer = e;
+	else
+		cache.oldest = e;
+	cache.newest = e;
+}
+
+/**
+ * Drop the least recently used outputs until the cache is within bounds.
+ * Called with the lock held.
+ */
+static void evict()
+{
+	char name[4096];
+	struct cache_entry * e;
+
+	while(cache.oldest && (cache.bytes > cache.max_bytes || cache.entries > cache.max_entries))
+	{
+		e = cache.oldest;
+		unlink_lru(e);
+		*find_entry(e->key) = e->chain;
+		entry_path(name, sizeof(name), e->key);
+		unlink(name);
+		cache.bytes -= e->size;
+		cache.entries--;
+		free(e);
+	}
+}
+
+/**
+ * Start caching into a directory.  Outputs left by an earlier run are not
+ * known to the new index and are removed.
+ * @return 0 on success, or -1 if the cache stays disabled
+ */
+int output_cache_open(const struct output_cache_config * config)
+{
+	char name[4096];
+	struct dirent * d;
+	DIR * dir;
+	size_t size = 16;
+
+	if(config->path == NULL)
+		return -1;
+	if(mkdir(config->path, 0700) && errno != EEXIST)
+	{
+		perror("mkdir");
+		return -1;
+	}
+	dir = opendir(config->path);
+	if(dir == NULL)
+	{
+		perror("opendir");
+		return -1;
+	}
+	while((d = readdir(dir)))
+	{
+		if(is_entry_name(d->d_name))
+		{
+			snprintf(name, sizeof(name), "%s/%s", config->path, d->d_name);
+			unlink(name);
+		}
+	}
+	closedir(dir);
+
+	while(size < 2 * config->max_entries)
+		size *= 2;
+	cache.buckets = calloc(size, sizeof(struct cache_entry *));
+	if(cache.buckets == NULL)
+		return -1;
+	cache.mask = size - 1;
+	cache.path = strdup(config->path);
+	cache.max_bytes = config->max_bytes;
+	cache.max_entries = config->max_entries;
+	return 0;
+}
+
+int output_cache_enabled(void)
+{
+	return cache.path != NULL;
+}
+
+/**
+ * Hash a job's file, then the hash with the printer's name, so the same file
+ * printed on another printer is cached apart.  The file is read with pread
+ * and its offset left alone.
+ * @return 0 on success, or -1 if the file could not be read
+ */
+int output_cache_key(int fd, const char * printer, unsigned char key[OUTPUT_CACHE_KEY])
+{
+	unsigned char * buffer;
+	unsigned char digest[32];
+	struct sha256 s;
+	off_t offset = 0;
+	ssize_t n;
+
+	buffer = malloc(HASH_CHUNK);
+	if(buffer == NULL)
+		return -1;
+	sha256_init(&s);
+	while((n = pread(fd, buffer, HASH_CHUNK, offset)) != 0)
+	{
+		if(n == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			free(buffer);
+			return -1;
+		}
+		sha256_update(&s, buffer, n);
+		offset += n;
+	}
+	free(buffer);
+	sha256_final(&s, digest);
+
+	sha256_init(&s);
+	sha256_update(&s, digest, sizeof(digest));
+	sha256_update(&s, printer, strlen(printer));
+	sha256_final(&s, key);
+	return 0;
+}
+
+/**
+ * Copy a cached output to where the printer would have put it
+ * @return 0 on a hit, or -1 on a miss or if the copy failed
+ */
+int output_cache_fetch(const unsigned char key[OUTPUT_CACHE_KEY], const char * path)
+{
+	char name[4096];
+	struct cache_entry * e;
+	int fd = -1;
+	int rv;
+
+	pthread_mutex_lock(&cache.lock);
+	e = *find_entry(key);
+	if(e)
+	{
+		unlink_lru(e);
+		push_lru(e);
+		// an open file stays readable even if it is evicted meanwhile
+		entry_path(name, sizeof(name), key);
+		fd = open(name, O_RDONLY | O_CLOEXEC);
+	}
+	pthread_mutex_unlock(&cache.lock);
+	if(fd == -1)
+		return -1;
+	rv = clone_file(fd, path);
+	close(fd);
+	return rv;
+}
+
+/**
+ * Keep a copy of a printed output.  An output too large for the whole cache
+ * is not kept.
+ */
+void output_cache_store(const unsigned char key[OUTPUT_CACHE_KEY], const char * path)
+{
+	char name[4096];
+	struct cache_entry ** slot;
+	struct cache_entry * e;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd == -1)
+		return;
+	if(fstat(fd, &st) || (size_t)st.st_size > cache.max_bytes)
+	{
+		close(fd);
+		return;
+	}
+	entry_path(name, sizeof(name), key);
+	if(clone_file(fd, name))
+	{
+		eprintf("Failed to cache %s\n", path);
+		close(fd);
+		return;
+	}
+	close(fd);
+
+	pthread_mutex_lock(&cache.lock);
+	slot = find_entry(key);
+	e = *slot;
+	if(e)
+	{
+		unlink_lru(e);
+		cache.bytes -= e->size;
+	}
+	else if((e = malloc(sizeof(struct cache_entry))))
+	{
+		memcpy(e->key, key, OUTPUT_CACHE_KEY);
+		e->chain = NULL;
+		*slot = e;
+		cache.entries++;
+	}
+	else
+	{
+		unlink(name);
+		pthread_mutex_unlock(&cache.lock);
+		return;
+	}
+	e->size = st.st_size;
+	cache.bytes += e->size;
+	push_lru(e);
+	evict();
+	pthread_mutex_unlock(&cache.lock);
+}
+
+void output_cache_close(void)
+{
+	struct cache_entry * e;
+
+	pthread_mutex_lock(&cache.lock);
+	while((e = cache.oldest))
+	{
+		unlink_lru(e);
+		free(e);
+	}
+	free(cache.buckets);
+	cache.buckets = NULL;
+	free(cache.path);
+	cache.path = NULL;
+	pthread_mutex_unlock(&cache.lock);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file      output_cache.h
+ * @date      2026-10-17: Created
+ * @brief     A bounded LRU cache of printed output keyed by job content
+ * @copyright MIT License (c) 2015, 2016
+ */
+
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#ifndef OUTPUT_CACHE_H
+#define OUTPUT_CACHE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// The size of a cache key, a SHA-256 digest
+#define OUTPUT_CACHE_KEY 32
+
+/**
+ * Where the cache keeps its files and how much it may keep.  A path of NULL
+ * leaves the cache disabled.
+ */
+struct output_cache_config
+{
+	// the directory holding one file per cached output
+	const char * path;
+	// the most bytes and the most outputs kept before the least recently
+	// used are dropped
+	size_t max_bytes;
+	size_t max_entries;
+};
+
+// empty the cache directory and start caching into it
+int output_cache_open(const struct output_cache_config * config);
+// whether output_cache_open() succeeded
+int output_cache_enabled(void);
+// work out the key for a job's file printed on a given printer
+int output_cache_key(int fd, const char * printer, unsigned char key[OUTPUT_CACHE_KEY]);
+// copy the output cached under key to path, returning -1 on a miss
+int output_cache_fetch(const unsigned char key[OUTPUT_CACHE_KEY], const char * path);
+// keep a copy of the output at path under key
+void output_cache_store(const unsigned char key[OUTPUT_CACHE_KEY], const char * path);
+// forget everything cached
+void output_cache_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,21 +20,59 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 #ifndef PRINT_JOB_H
 #define PRINT_JOB_H
 
+#include <sys/types.h>
+#include <time.h>
+#include <stdatomic.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif 
 
+/// Bytes kept in each job for its file name, job name and description
+#define JOB_INLINE_STRINGS 256
+
+struct print_job_list;
 
 struct print_job
 {
 	struct print_job * next_job;
+	// the job before this one in a doubly linked job list
+	struct print_job * prev_job;
+	// the list holding the job, its place in a heap, and whether it is
+	// queued, paused, printing or cancelled; all kept by print_job_list
+	struct print_job_list * queue;
+	size_t heap_index;
+	atomic_int state;
+	// the list the main thread last queued the job on; unlike queue it is
+	// only touched by the main thread, and kept while a printer has the job
+	struct print_job_list * assigned;
 	char* file_name;
+	// the job file passed by the client, or -1 to open file_name instead
+	int fd;
 	char* job_name;
 	char* description;
-	char* group_name;
-	time_t arrival_time;
-	time_t finish_time;
+	// the index of the printer group the job was sent to
+	int group;
+	// the user that submitted the job
+	uid_t owner;
+	// higher priority jobs print first under the priority scheduler
+	int priority;
+	// the size in bytes of the job's file when it was submitted
+	long long size;
+	// monotonic nanoseconds at each step of the job's life: the request
+	// arriving, joining the queue, a printer taking it, the first byte
+	// reaching the driver and the driver reporting it printed
+	unsigned long long accept_ns;
+	unsigned long long enqueue_ns;
+	unsigned long long dispatch_ns;
+	unsigned long long first_byte_ns;
+	unsigned long long complete_ns;
 	long long job_number;
+	// how many times a failing printer has put the job back on the queue
+	int attempts;
+	// space for short strings, managed by the job pool; must stay last
+	size_t strings_used;
+	char strings[JOB_INLINE_STRINGS];
 };
 
 
@@ -0,0 +1,957 @@
+/**
+ * @file      print_job_list.c
+ * @date      2026-10-17: Created
+ * @brief     The scheduling policies that hand out the jobs of a print_job_list
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "print_job_list.h"
+
+/// How many times an empty ring is polled before a printer goes to sleep
+#define RING_SPIN 64
+
+/**
+ * One slot of the ring.  The sequence number tells producers and consumers
+ * whose turn it is to use the slot.
+ */
+struct job_ring_cell
+{
+	atomic_size_t seq;
+	struct print_job * job;
+};
+
+/**
+ * A bounded multi-producer multi-consumer ring of jobs (after Dmitry Vyukov's
+ * bounded MPMC queue).  Producers and consumers each claim a position with a
+ * single compare and swap; an eventfd is only touched when a printer has run
+ * out of work and is asleep.
+ */
+struct job_ring
+{
+	// the number of cells minus one, the size is a power of two
+	size_t mask;
+	// the next position to be written, on its own cache line
+	_Alignas(64) atomic_size_t enqueue_pos;
+	// the next position to be read, on its own cache line
+	_Alignas(64) atomic_size_t dequeue_pos;
+	// the number of printers sleeping on the eventfd
+	_Alignas(64) atomic_int sleepers;
+	// wakes sleeping printers, one count per wakeup
+	int event_fd;
+	// the slots of the ring
+	struct job_ring_cell cells[];
+};
+
+
+// -- POLICIES KEPT UNDER THE LIST LOCK -- //
+
+static int locked_init(struct print_job_list * list)
+{
+	list->head = NULL;
+	list->tail = NULL;
+	list->count = 0;
+	if(sem_init(&list->num_jobs, 0, 0))
+		return -1;
+	if(pthread_mutex_init(&list->lock, NULL))
+		return -1;
+	return 0;
+}
+
+static void locked_destroy(struct print_job_list * list)
+{
+	sem_destroy(&list->num_jobs);
+	pthread_mutex_destroy(&list->lock);
+}
+
+static int locked_push(struct print_job_list * list, struct print_job * job)
+{
+	int rv;
+
+	pthread_mutex_lock(&list->lock);
+	rv = list->ops->insert(list, job);
+	if(rv == 0)
+	{
+		job->queue = list;
+		atomic_store_explicit(&job->state, PRINT_JOB_QUEUED, memory_order_relaxed);
+		list->count++;
+	}
+	pthread_mutex_unlock(&list->lock);
+	if(rv)
+		return rv;
+
+	// wake up one of the printers waiting on this list
+	sem_post(&list->num_jobs);
+	return 0;
+}
+
+static struct print_job * locked_pop(struct print_job_list * list)
+{
+	struct print_job * job;
+	int cancel_state;
+
+	while(1)
+	{
+		// wait for an item to be in the list, the one place a printer being
+		// uninstalled may be cancelled
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &cancel_state);
+		while(sem_wait(&list->num_jobs))
+		{
+			if(errno != EINTR)
+			{
+				perror("sem_wait");
+				abort();
+			}
+		}
+		pthread_setcancelstate(cancel_state, NULL);
+
+		// the job we were woken for may have been cancelled in the meantime
+		pthread_mutex_lock(&list->lock);
+		if(list->count)
+			break;
+		pthread_mutex_unlock(&list->lock);
+	}
+	job = list->ops->remove(list);
+	job->queue = NULL;
+	atomic_store_explicit(&job->state, PRINT_JOB_TAKEN, memory_order_relaxed);
+	list->count--;
+	pthread_mutex_unlock(&list->lock);
+
+	job->next_job = NULL;
+	job->prev_job = NULL;
+	return job;
+}
+
+/**
+ * Take a job out of a locked list, if it is still there.  Called with the
+ * list lock held.
+ * @return 0 if the job was taken out, or -1 if it is not in the list
+ */
+static int locked_erase(struct print_job_list * list, struct print_job * job)
+{
+	if(job->queue != list)
+		return -1;
+	list->ops->erase(list, job);
+	job->queue = NULL;
+	job->next_job = NULL;
+	job->prev_job = NULL;
+	list->count--;
+	// take the job's count back, unless a printer has already claimed it, in
+	// which case that printer finds the list emptier than it expected
+	sem_trywait(&list->num_jobs);
+	return 0;
+}
+
+static int fifo_insert(struct print_job_list * list, struct print_job * job)
+{
+	job->next_job = NULL;
+	job->prev_job = list->tail;
+	if(list->tail)
+		list->tail->next_job = job;
+	else
+		list->head = job;
+	list->tail = job;
+	return 0;
+}
+
+static struct print_job * fifo_remove(struct print_job_list * list)
+{
+	struct print_job * job = list->head;
+
+	list->head = job->next_job;
+	if(list->head)
+		list->head->prev_job = NULL;
+	else
+		// that was the only item in the list
+		list->tail = NULL;
+	return job;
+}
+
+static void fifo_erase(struct print_job_list * list, struct print_job * job)
+{
+	if(job->prev_job)
+		job->prev_job->next_job = job->next_job;
+	else
+		list->head = job->next_job;
+	if(job->next_job)
+		job->next_job->prev_job = job->prev_job;
+	else
+		list->tail = job->prev_job;
+}
+
+const struct print_job_list_ops print_job_list_fifo = {
+	.name = "fcfs",
+	.init = locked_init,
+	.push = locked_push,
+	.pop = locked_pop,
+	.insert = fifo_insert,
+	.remove = fifo_remove,
+	.erase = fifo_erase,
+	.destroy = locked_destroy,
+};
+
+
+// -- HEAP ORDERED POLICIES -- //
+
+/**
+ * A binary min-heap of jobs ordered by the policy's `before` function.
+ */
+struct job_heap
+{
+	// returns non-zero if job a should print before job b
+	int (*before)(const struct print_job * a, const struct print_job * b);
+	// the jobs in heap order
+	struct print_job ** jobs;
+	// the number of jobs in the heap
+	size_t len;
+	// the allocated size of jobs
+	size_t size;
+};
+
+static int sjf_before(const struct print_job * a, const struct print_job * b)
+{
+	if(a->size != b->size)
+		return a->size < b->size;
+	return a->job_number < b->job_number;
+}
+
+static int priority_before(const struct print_job * a, const struct print_job * b)
+{
+	if(a->priority != b->priority)
+		return a->priority > b->priority;
+	return a->job_number < b->job_number;
+}
+
+static int heap_init(struct print_job_list * list, int (*before)(const struct print_job *, const struct print_job *))
+{
+	struct job_heap * heap = calloc(1, sizeof(struct job_heap));
+
+	if(heap == NULL)
+		return -1;
+	heap->before = before;
+	list->data = heap;
+	return locked_init(list);
+}
+
+static int sjf_init(struct print_job_list * list)
+{
+	return heap_init(list, sjf_before);
+}
+
+static int priority_init(struct print_job_list * list)
+{
+	return heap_init(list, priority_before);
+}
+
+static void heap_destroy(struct print_job_list * list)
+{
+	struct job_heap * heap = list->data;
+
+	free(heap->jobs);
+	free(heap);
+	list->data = NULL;
+	locked_destroy(list);
+}
+
+/**
+ * Put a job into the heap at position i, which is free, and sift it up or
+ * down to where it belongs.  Every job moved keeps its position in
+ * heap_index so it can be erased without a search.
+ */
+static void heap_place(struct job_heap * heap, size_t i, struct print_job * job)
+{
+	size_t parent, child;
+
+	// sift up while the job should print before its parent
+	for(; i > 0; i = parent)
+	{
+		parent = (i - 1) / 2;
+		if(!heap->before(job, heap->jobs[parent]))
+			break;
+		heap->jobs[i] = heap->jobs[parent];
+		heap->jobs[i]->heap_index = i;
+	}
+	// sift down while a child should print before the job
+	for(; (child = 2 * i + 1) < heap->len; i = child)
+	{
+		if(child + 1 < heap->len && heap->before(heap->jobs[child + 1], heap->jobs[child]))
+			child++;
+		if(!heap->before(heap->jobs[child], job))
+			break;
+		heap->jobs[i] = heap->jobs[child];
+		heap->jobs[i]->heap_index = i;
+	}
+	heap->jobs[i] = job;
+	job->heap_index = i;
+}
+
+static int heap_insert(struct print_job_list * list, struct print_job * job)
+{
+	struct job_heap * heap = list->data;
+	struct print_job ** jobs;
+
+	if(heap->len == heap->size)
+	{
+		jobs = realloc(heap->jobs, (heap->size ? heap->size * 2 : 64) * sizeof(struct print_job *));
+		if(jobs == NULL)
+			return -1;
+		heap->jobs = jobs;
+		heap->size = heap->size ? heap->size * 2 : 64;
+	}
+
+	heap_place(heap, heap->len++, job);
+	return 0;
+}
+
+static struct print_job * heap_remove(struct print_job_list * list)
+{
+	struct job_heap * heap = list->data;
+	struct print_job * job = heap->jobs[0];
+	struct print_job * last = heap->jobs[--heap->len];
+
+	if(heap->len)
+		heap_place(heap, 0, last);
+	return job;
+}
+
+static void heap_erase(struct print_job_list * list, struct print_job * job)
+{
+	struct job_heap * heap = list->data;
+	struct print_job * last = heap->jobs[--heap->len];
+
+	// the last job fills the hole, then moves whichever way it belongs
+	if(job != last)
+		heap_place(heap, job->heap_index, last);
+}
+
+const struct print_job_list_ops print_job_list_sjf = {
+	.name = "sjf",
+	.init = sjf_init,
+	.push = locked_push,
+	.pop = locked_pop,
+	.insert = heap_insert,
+	.remove = heap_remove,
+	.erase = heap_erase,
+	.destroy = heap_destroy,
+};
+
+const struct print_job_list_ops print_job_list_priority = {
+	.name = "priority",
+	.init = priority_init,
+	.push = locked_push,
+	.pop = locked_pop,
+	.insert = heap_insert,
+	.remove = heap_remove,
+	.erase = heap_erase,
+	.destroy = heap_destroy,
+};
+
+
+// -- ROUND ROBIN POLICY -- //
+
+/**
+ * The queued jobs of one user
+ */
+struct rr_owner
+{
+	// the user these jobs belong to
+	uid_t owner;
+	// the user's jobs, oldest first
+	struct print_job * head;
+	struct print_job * tail;
+	// the next user in the rotation
+	struct rr_owner * next;
+};
+
+/**
+ * Users with queued jobs are kept in a circular list and served one job at
+ * a time in turn, so one user flooding a group cannot starve the others.
+ */
+struct rr_state
+{
+	// the user served last; the next user to be served follows it
+	struct rr_owner * last;
+	// users without queued jobs, kept for reuse
+	struct rr_owner * spare;
+};
+
+static int rr_init(struct print_job_list * list)
+{
+	list->data = calloc(1, sizeof(struct rr_state));
+	if(list->data == NULL)
+		return -1;
+	return locked_init(list);
+}
+
+static void rr_destroy(struct print_job_list * list)
+{
+	struct rr_state * rr = list->data;
+	struct rr_owner * o;
+
+	// an emptied list has every user it ever served on the spare list
+	while((o = rr->spare))
+	{
+		rr->spare = o->next;
+		free(o);
+	}
+	free(rr);
+	list->data = NULL;
+	locked_destroy(list);
+}
+
+static int rr_insert(struct print_job_list * list, struct print_job * job)
+{
+	struct rr_state * rr = list->data;
+	struct rr_owner * o = NULL;
+
+	// find the user among those with queued jobs
+	if(rr->last)
+	{
+		o = rr->last;
+		do {
+			if(o->owner == job->owner)
+				break;
+			o = o->next;
+		} while(o != rr->last);
+		if(o->owner != job->owner)
+			o = NULL;
+	}
+
+	// otherwise the user joins at the end of the rotation
+	if(o == NULL)
+	{
+		if(rr->spare)
+		{
+			o = rr->spare;
+			rr->spare = o->next;
+		}
+		else if((o = malloc(sizeof(struct rr_owner))) == NULL)
+		{
+			return -1;
+		}
+		o->owner = job->owner;
+		o->head = NULL;
+		o->tail = NULL;
+		if(rr->last)
+		{
+			o->next = rr->last->next;
+			rr->last->next = o;
+		}
+		else
+		{
+			o->next = o;
+		}
+		rr->last = o;
+	}
+
+	job->next_job = NULL;
+	job->prev_job = o->tail;
+	if(o->tail)
+		o->tail->next_job = job;
+	else
+		o->head = job;
+	o->tail = job;
+	return 0;
+}
+
+/**
+ * Take a user with no jobs left out of the rotation.  prev is the user before
+ * them in the rotation.
+ */
+static void rr_retire(struct rr_state * rr, struct rr_owner * prev, struct rr_owner * o)
+{
+	o->tail = NULL;
+	if(o == prev)
+		rr->last = NULL;
+	else
+	{
+		prev->next = o->next;
+		if(rr->last == o)
+			rr->last = prev;
+	}
+	o->next = rr->spare;
+	rr->spare = o;
+}
+
+static struct print_job * rr_remove(struct print_job_list * list)
+{
+	struct rr_state * rr = list->data;
+	struct rr_owner * o = rr->last->next;
+	struct print_job * job = o->head;
+
+	o->head = job->next_job;
+	if(o->head)
+	{
+		o->head->prev_job = NULL;
+		// the user goes to the back of the rotation
+		rr->last = o;
+		return job;
+	}
+
+	// the user has nothing left, take them out of the rotation
+	rr_retire(rr, rr->last, o);
+	return job;
+}
+
+static void rr_erase(struct print_job_list * list, struct print_job * job)
+{
+	struct rr_state * rr = list->data;
+	struct rr_owner * prev = rr->last;
+	struct rr_owner * o;
+
+	// find the job's user, and the user before them in the rotation
+	while((o = prev->next)->owner != job->owner)
+		prev = o;
+
+	if(job->prev_job)
+		job->prev_job->next_job = job->next_job;
+	else
+		o->head = job->next_job;
+	if(job->next_job)
+		job->next_job->prev_job = job->prev_job;
+	else
+		o->tail = job->prev_job;
+	if(o->head == NULL)
+		rr_retire(rr, prev, o);
+}
+
+const struct print_job_list_ops print_job_list_rr = {
+	.name = "rr",
+	.init = rr_init,
+	.push = locked_push,
+	.pop = locked_pop,
+	.insert = rr_insert,
+	.remove = rr_remove,
+	.erase = rr_erase,
+	.destroy = rr_destroy,
+};
+
+
+// -- LOCK-FREE RING BACKEND -- //
+
+static int ring_init(struct print_job_list * list)
+{
+	struct job_ring * ring;
+	size_t size = 1;
+	size_t i;
+
+	// round the capacity up to a power of two so positions can be masked
+	while(size < (list->capacity ? list->capacity : PRINT_JOB_LIST_RING_SIZE))
+		size <<= 1;
+
+	if(posix_memalign((void**)&ring, 64, sizeof(struct job_ring) + size * sizeof(struct job_ring_cell)))
+		return -1;
+	memset(ring, 0, sizeof(struct job_ring));
+	ring->mask = size - 1;
+	for(i = 0; i < size; i++)
+	{
+		atomic_init(&ring->cells[i].seq, i);
+		ring->cells[i].job = NULL;
+	}
+	atomic_init(&ring->enqueue_pos, 0);
+	atomic_init(&ring->dequeue_pos, 0);
+	atomic_init(&ring->sleepers, 0);
+	ring->event_fd = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
+	if(ring->event_fd == -1)
+	{
+		free(ring);
+		return -1;
+	}
+
+	list->capacity = size;
+	list->data = ring;
+	return 0;
+}
+
+static int ring_push(struct print_job_list * list, struct print_job * job)
+{
+	struct job_ring * ring = list->data;
+	struct job_ring_cell * cell;
+	size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+	intptr_t diff;
+	uint64_t one = 1;
+	int sleepers;
+
+	while(1)
+	{
+		cell = &ring->cells[pos & ring->mask];
+		diff = (intptr_t)atomic_load_explicit(&cell->seq, memory_order_acquire) - (intptr_t)pos;
+		if(diff == 0)
+		{
+			// the cell is free, try to claim it
+			if(atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if(diff < 0)
+		{
+			// the ring is full
+			return -1;
+		}
+		else
+		{
+			// another producer got here first
+			pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+		}
+	}
+
+	job->next_job = NULL;
+	// a job put back by a failing printer is still marked as taken
+	atomic_store_explicit(&job->state, PRINT_JOB_QUEUED, memory_order_relaxed);
+	cell->job = job;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+	// only pay for a system call if a printer is asleep, and claim that
+	// printer so it is woken exactly once
+	atomic_thread_fence(memory_order_seq_cst);
+	sleepers = atomic_load_explicit(&ring->sleepers, memory_order_relaxed);
+	while(sleepers > 0)
+	{
+		if(atomic_compare_exchange_weak(&ring->sleepers, &sleepers, sleepers - 1))
+		{
+			if(write(ring->event_fd, &one, sizeof(one)) != sizeof(one))
+				perror("eventfd write");
+			break;
+		}
+	}
+	return 0;
+}
+
+static struct print_job * ring_try_pop(struct job_ring * ring)
+{
+	struct job_ring_cell * cell;
+	struct print_job * job;
+	size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+	intptr_t diff;
+
+	while(1)
+	{
+		cell = &ring->cells[pos & ring->mask];
+		diff = (intptr_t)atomic_load_explicit(&cell->seq, memory_order_acquire) - (intptr_t)(pos + 1);
+		if(diff == 0)
+		{
+			// the cell holds a job, try to claim it
+			if(atomic_compare_exchange_weak_explicit(&ring->dequeue_pos, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if(diff < 0)
+		{
+			// the ring is empty
+			return NULL;
+		}
+		else
+		{
+			// another printer got here first
+			pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+		}
+	}
+
+	job = cell->job;
+	atomic_store_explicit(&cell->seq, pos + ring->mask + 1, memory_order_release);
+	return job;
+}
+
+/**
+ * Claim a job just taken from a ring for the printer that took it.  A job
+ * that was paused in the ring is left for resume to push again, and one
+ * that was cancelled is released.
+ * @return 1 if the printer should print the job, 0 if it was a tombstone
+ */
+static int ring_claim(struct print_job_list * list, struct print_job * job)
+{
+	int state = PRINT_JOB_QUEUED;
+
+	while(1)
+	{
+		switch(state)
+		{
+			case PRINT_JOB_QUEUED:
+				if(atomic_compare_exchange_weak(&job->state, &state, PRINT_JOB_TAKEN))
+					return 1;
+				break;
+			case PRINT_JOB_PAUSED:
+				if(atomic_compare_exchange_weak(&job->state, &state, PRINT_JOB_EVICTED))
+					return 0;
+				break;
+			case PRINT_JOB_CANCELLED:
+				if(list->release)
+					list->release(job);
+				return 0;
+			default:
+				// nothing else can be found in a ring
+				return 0;
+		}
+	}
+}
+
+/**
+ * Take back a printer's announcement that it is going to sleep, unless a
+ * producer already claimed it, in which case the extra wakeup is simply
+ * absorbed later.
+ */
+static void ring_unsleep(void * arg)
+{
+	struct job_ring * ring = arg;
+	int sleepers = atomic_load(&ring->sleepers);
+
+	while(sleepers > 0 && !atomic_compare_exchange_weak(&ring->sleepers, &sleepers, sleepers - 1));
+}
+
+static struct print_job * ring_pop(struct print_job_list * list)
+{
+	struct job_ring * ring = list->data;
+	struct print_job * job;
+	uint64_t count;
+	int cancel_state;
+	int rv;
+	int i;
+
+	while(1)
+	{
+		for(i = 0; i < RING_SPIN; i++)
+		{
+			if((job = ring_try_pop(ring)))
+			{
+				if(ring_claim(list, job))
+					return job;
+				// that was a tombstone, it does not count as work
+				i = 0;
+			}
+		}
+
+		// announce that we are about to sleep, then look one last time so a
+		// job pushed in between cannot be missed
+		atomic_fetch_add(&ring->sleepers, 1);
+		if((job = ring_try_pop(ring)))
+		{
+			ring_unsleep(ring);
+			if(ring_claim(list, job))
+				return job;
+			continue;
+		}
+		// the producer that wakes us also removes us from the sleepers; a
+		// printer being uninstalled may be cancelled while it sleeps here
+		pthread_cleanup_push(ring_unsleep, ring);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &cancel_state);
+		rv = read(ring->event_fd, &count, sizeof(count));
+		pthread_setcancelstate(cancel_state, NULL);
+		pthread_cleanup_pop(0);
+		if(rv == -1 && errno != EINTR)
+		{
+			perror("eventfd read");
+			abort();
+		}
+	}
+}
+
+static void ring_destroy(struct print_job_list * list)
+{
+	struct job_ring * ring = list->data;
+
+	close(ring->event_fd);
+	free(ring);
+	list->data = NULL;
+}
+
+const struct print_job_list_ops print_job_list_ring = {
+	.name = "ring",
+	.init = ring_init,
+	.push = ring_push,
+	.pop = ring_pop,
+	.destroy = ring_destroy,
+};
+
+
+// -- PUBLIC INTERFACE -- //
+
+const struct print_job_list_ops * print_job_list_find_ops(const char * name)
+{
+	static const struct print_job_list_ops * const policies[] = {
+		&print_job_list_fifo,
+		&print_job_list_ring,
+		&print_job_list_sjf,
+		&print_job_list_rr,
+		&print_job_list_priority,
+	};
+	unsigned i;
+
+	for(i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+	{
+		if(strcmp(name, policies[i]->name) == 0)
+			return policies[i];
+	}
+	return NULL;
+}
+
+int print_job_list_init(struct print_job_list * list)
+{
+	if(list->ops == NULL)
+		list->ops = &print_job_list_fifo;
+	return list->ops->init(list);
+}
+
+/**
+ * Free an empty list.  Jobs still queued are not released, and no printer
+ * may be waiting on the list any more.
+ */
+void print_job_list_destroy(struct print_job_list * list)
+{
+	list->ops->destroy(list);
+}
+
+int print_job_list_push(struct print_job_list * list, struct print_job * job)
+{
+	return list->ops->push(list, job);
+}
+
+struct print_job * print_job_list_pop(struct print_job_list * list)
+{
+	int cancel_state;
+
+	// a printer that is being uninstalled goes before taking another job,
+	// even if the list never runs dry
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &cancel_state);
+	pthread_testcancel();
+	pthread_setcancelstate(cancel_state, NULL);
+	return list->ops->pop(list);
+}
+
+/**
+ * Take the next job out of a list without waiting, so it can be queued
+ * somewhere else.  A lock-free ring cannot be emptied from the side, so only
+ * the policies kept under the list lock give up their jobs.
+ * @return the job, or NULL if the list is empty or is a ring
+ */
+struct print_job * print_job_list_take(struct print_job_list * list)
+{
+	struct print_job * job = NULL;
+
+	if(list->ops->erase == NULL)
+		return NULL;
+	pthread_mutex_lock(&list->lock);
+	if(list->count)
+	{
+		job = list->ops->remove(list);
+		job->queue = NULL;
+		atomic_store_explicit(&job->state, PRINT_JOB_TAKEN, memory_order_relaxed);
+		list->count--;
+		// as with an erased job, a printer that already claimed the count
+		// finds the list emptier than it expected
+		sem_trywait(&list->num_jobs);
+	}
+	pthread_mutex_unlock(&list->lock);
+	if(job)
+	{
+		job->next_job = NULL;
+		job->prev_job = NULL;
+	}
+	return job;
+}
+
+/**
+ * Cancel a job that no printer has yet.  The caller must know the job has
+ * not been recycled since it was pushed.
+ * @return 0 if the job is out of the list and the caller should free it,
+ *         1 if it was left in a ring, which frees it through list->release,
+ *         or -1 if a printer already has it
+ */
+int print_job_list_cancel(struct print_job_list * list, struct print_job * job)
+{
+	int state;
+	int rv;
+
+	if(list->ops->erase == NULL)
+	{
+		state = atomic_load(&job->state);
+		while(1)
+		{
+			if(state != PRINT_JOB_QUEUED && state != PRINT_JOB_PAUSED && state != PRINT_JOB_EVICTED)
+				return -1;
+			// a cancelled job can no longer be resumed
+			if(atomic_compare_exchange_weak(&job->state, &state, PRINT_JOB_CANCELLED))
+				return state == PRINT_JOB_EVICTED ? 0 : 1;
+		}
+	}
+
+	pthread_mutex_lock(&list->lock);
+	if(atomic_load_explicit(&job->state, memory_order_relaxed) == PRINT_JOB_PAUSED)
+		rv = 0;
+	else
+		rv = locked_erase(list, job);
+	if(rv == 0)
+		atomic_store_explicit(&job->state, PRINT_JOB_CANCELLED, memory_order_relaxed);
+	pthread_mutex_unlock(&list->lock);
+	return rv;
+}
+
+/**
+ * Hold a job back from the printers until it is resumed.  Pausing a paused
+ * job does nothing.
+ * @return 0 if the job is paused, or -1 if a printer already has it
+ */
+int print_job_list_pause(struct print_job_list * list, struct print_job * job)
+{
+	int state;
+	int rv = 0;
+
+	if(list->ops->erase == NULL)
+	{
+		state = PRINT_JOB_QUEUED;
+		if(atomic_compare_exchange_strong(&job->state, &state, PRINT_JOB_PAUSED))
+			return 0;
+		return state == PRINT_JOB_PAUSED || state == PRINT_JOB_EVICTED ? 0 : -1;
+	}
+
+	pthread_mutex_lock(&list->lock);
+	if(atomic_load_explicit(&job->state, memory_order_relaxed) != PRINT_JOB_PAUSED)
+	{
+		rv = locked_erase(list, job);
+		if(rv == 0)
+			atomic_store_explicit(&job->state, PRINT_JOB_PAUSED, memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&list->lock);
+	return rv;
+}
+
+/**
+ * Let a paused job be printed again.  A job paused in a ring that has not
+ * been skipped yet keeps its place; any other job joins the list again as
+ * if it were new.
+ * @return 0 if the job is queued again, or -1 if it was not paused or the
+ *         list is full
+ */
+int print_job_list_resume(struct print_job_list * list, struct print_job * job)
+{
+	int state = PRINT_JOB_PAUSED;
+
+	if(list->ops->erase == NULL && atomic_compare_exchange_strong(&job->state, &state, PRINT_JOB_QUEUED))
+		return 0;
+	if(atomic_load(&job->state) != (list->ops->erase ? PRINT_JOB_PAUSED : PRINT_JOB_EVICTED))
+		return -1;
+	atomic_store(&job->state, PRINT_JOB_QUEUED);
+	if(list->ops->push(list, job))
+	{
+		atomic_store(&job->state, list->ops->erase ? PRINT_JOB_PAUSED : PRINT_JOB_EVICTED);
+		return -1;
+	}
+	return 0;
+}
+
@@ -0,0 +1,147 @@
+/**
+ * @file      print_job_list.h
+ * @date      2026-10-17: Created
+ * @brief     A thread safe queue of print jobs shared by the printers of a group
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#ifndef PRINT_JOB_LIST_H
+#define PRINT_JOB_LIST_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stddef.h>
+
+#include "print_job.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+struct print_job_list;
+
+/**
+ * A scheduling policy for a job list.  The policy decides which of the queued
+ * jobs a printer gets next.  Policies that keep their jobs under the list
+ * lock only provide `insert` and `remove` and share the generic locking
+ * push/pop; a policy with its own synchronization provides `push` and `pop`.
+ */
+struct print_job_list_ops
+{
+	// the name used to select this policy in config.rc
+	const char * name;
+	// allocate whatever the policy needs
+	int (*init)(struct print_job_list * list);
+	// add a job, returning -1 if the list is full
+	int (*push)(struct print_job_list * list, struct print_job * job);
+	// block until a job is available and remove it
+	struct print_job * (*pop)(struct print_job_list * list);
+	// add a job while holding the list lock
+	int (*insert)(struct print_job_list * list, struct print_job * job);
+	// remove the next job while holding the list lock
+	struct print_job * (*remove)(struct print_job_list * list);
+	// take a given job out of the list while holding the list lock; a policy
+	// without erase leaves cancelled and paused jobs where they are, and its
+	// pop skips them
+	void (*erase)(struct print_job_list * list, struct print_job * job);
+	// free whatever init allocated
+	void (*destroy)(struct print_job_list * list);
+};
+
+/**
+ * Where a job stands with the list it was pushed to.  A lock-free ring
+ * cannot take a job out of the middle, so a cancelled or paused job stays in
+ * its cell and is skipped by the printer that comes across it.
+ */
+enum print_job_state
+{
+	// waiting in the list
+	PRINT_JOB_QUEUED = 0,
+	// handed to a printer
+	PRINT_JOB_TAKEN,
+	// held back from the printers
+	PRINT_JOB_PAUSED,
+	// paused, and since skipped over by a ring, so no longer in it
+	PRINT_JOB_EVICTED,
+	// cancelled; in a ring it stays until a printer skips and releases it
+	PRINT_JOB_CANCELLED,
+};
+
+/**
+ * A list of print jobs that must be kept thread safe.  Before calling
+ * print_job_list_init() the caller may pick a policy through `ops` and
+ * bound its size through `capacity`; left zeroed, the jobs are handed out
+ * first come first served from a mutex protected linked list.
+ */
+struct print_job_list
+{
+	// the scheduling policy in use for this list
+	const struct print_job_list_ops * ops;
+	// the most jobs a bounded policy can hold
+	size_t capacity;
+	// the oldest job in the list, the next one to be printed
+	struct print_job * head;
+	// the newest job in the list
+	struct print_job * tail;
+	// the number of jobs in the list
+	sem_t num_jobs;
+	// the number of jobs in a list kept under the lock, which can fall
+	// behind num_jobs while a job is being cancelled
+	size_t count;
+	// a lock for the list
+	pthread_mutex_t lock;
+	// state private to the scheduling policy
+	void * data;
+	// frees a job cancelled while in a ring, once a printer has skipped it
+	void (*release)(struct print_job * job);
+};
+
+/// First come first served from a linked list guarded by a mutex
+extern const struct print_job_list_ops print_job_list_fifo;
+/// First come first served from a bounded lock-free ring
+extern const struct print_job_list_ops print_job_list_ring;
+/// Shortest job first, by the size of the job's file at submit time
+extern const struct print_job_list_ops print_job_list_sjf;
+/// Round robin between the users that submitted jobs
+extern const struct print_job_list_ops print_job_list_rr;
+/// Strict priority, first come first served within a priority
+extern const struct print_job_list_ops print_job_list_priority;
+
+/// The number of jobs a ring holds if no capacity is configured
+#define PRINT_JOB_LIST_RING_SIZE 65536
+
+// look up a policy by the name used in config.rc
+const struct print_job_list_ops * print_job_list_find_ops(const char * name);
+// initialize an empty job list
+int print_job_list_init(struct print_job_list * list);
+// free an empty job list no printer is waiting on any more
+void print_job_list_destroy(struct print_job_list * list);
+// add a job to the list and wake one waiting printer
+int print_job_list_push(struct print_job_list * list, struct print_job * job);
+// block until a job is available and remove the one the policy picks; a
+// printer thread can only be cancelled in here, before it holds a job
+struct print_job * print_job_list_pop(struct print_job_list * list);
+// take the next job out of a list kept under the lock without waiting
+struct print_job * print_job_list_take(struct print_job_list * list);
+// take a queued job away from the printers for good
+int print_job_list_cancel(struct print_job_list * list, struct print_job * job);
+// hold a queued job back from the printers
+int print_job_list_pause(struct print_job_list * list, struct print_job * job);
+// let a paused job be printed again
+int print_job_list_resume(struct print_job_list * list, struct print_job * job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -5,6 +5,7 @@
  * @date      2015-02-15: Last updated
  * @date      2016-02-16: Complete re-write
  * @date      2016-02-20: convert to single threaded
+ * @date      2026-10-17: threaded and event driven rework
  * @brief     Emulate a print server system
  * @copyright MIT License (c) 2015, 2016
  */
@@ -20,47 +21,260 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <assert.h>
 #include <string.h>
 #include <semaphore.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <mqueue.h>
+#include <time.h>
 #include <unistd.h>
 
 
 #include "print_job.h"
+#include "print_job_list.h"
+#include "job_pool.h"
+#include "job_index.h"
 #include "printer_driver.h"
+#include "job_log.h"
+#include "journal.h"
+#include "output_cache.h"
+#include "stats.h"
 #include "debug.h"
+#include "../libprintserver/print_server_proto.h"
 
 // -- GLOBAL VARIABLES -- //
 int verbose_flag = 0;
 int exit_flag = 0;
 char *socket_path = "\0hidden";
-char buffer[2048];
-char listBuf[200];
 // -- STATIC VARIABLES -- //
 static struct printer_group * printer_group_head;
-
-// -- FUNCTION PROTOTYPES -- //
-static void parse_command_line(int argc, char * argv[]);
-static void parse_rc_file(FILE* fp);
-static void accept_socket();
-static void list_printer_drivers();
+// the printer groups indexed by their group number
+static struct printer_group ** printer_groups;
+static int num_printer_groups;
+// open addressed hash table from group name to group, a power of two in size
+static struct printer_group ** group_table;
+static unsigned group_table_mask;
+static long long job_number = 0;
+// where and how the job log is written, LOG_* lines in config.rc override it
+static struct job_log_config log_config = {
+	.path = "config.txt",
+	.flush_ms = 1000,
+	.rotate_bytes = 1024 * 1024,
+	.keep = 3,
+	.lines = 4096,
+};
+// the journal of queued jobs, set with JOURNAL lines in config.rc
+static char * journal_path = "jobs.journal";
+static size_t journal_compact_bytes = 64 * 1024 * 1024;
+// how printers deal with a misbehaving driver, set with DRIVER lines in
+// config.rc: the driver timeouts, the failed jobs in a row that trip a
+// printer, how often a tripped printer tries its driver again, and how many
+// times a failed job is put back on its queue
+static int driver_write_timeout_ms = 10000;
+static int driver_ack_timeout_ms = 120000;
+static int driver_install_timeout_ms = 2000;
+static int driver_failures = 3;
+static int driver_cooldown_ms = 5000;
+static int driver_retries = 3;
+// the output cache, off unless a directory is configured, and where the
+// drivers of the printers configured next write what they print
+static struct output_cache_config cache_config = {
+	.path = NULL,
+	.max_bytes = 256 * 1024 * 1024,
+	.max_entries = 1024,
+};
+static char * output_dir;
+// the outputs being written by printers that cache them, so a job's output
+// cannot be overwritten by another job of the same name before it is cached
+static struct output_claim
+{
+	// the file the driver writes the job's output to
+	const char * path;
+	struct output_claim * next;
+} * output_claims;
+static pthread_mutex_t output_claims_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t output_claims_freed = PTHREAD_COND_INITIALIZER;
 /**
- * A list of print jobs that must be kept thread safe
+ * The installed printers as sent to clients, one "name|group" line each.  A
+ * listing is never changed once built: installing or uninstalling a printer
+ * builds a new one with the next epoch.
  */
-struct print_job_list
+static struct driver_list
+{
+	uint32_t epoch;
+	uint32_t count;
+	uint32_t length;
+	char text[];
+} * driver_list;
+// the message queue clients may submit through, if one is configured, and
+// the buffer its messages are received into
+static struct
+{
+	char * name;
+	mqd_t q;
+	char * buf;
+	long msgsize;
+} mqueue = { .q = (mqd_t)-1 };
+// unfinished jobs by job number, only touched by the main thread
+static struct job_index job_index;
+/// how many finished jobs are remembered for a late WAIT, a power of two
+#define RETIRED_JOBS 4096
+// how the most recently finished jobs ended, by job number modulo the size;
+// a WAIT on an older job cannot be answered for sure
+static struct
+{
+	long long job_number;
+	int status;
+} retired_jobs[RETIRED_JOBS];
+// finished jobs waiting for the main thread, which is woken through fd
+static struct
+{
+	pthread_mutex_t lock;
+	int fd;
+	struct completion * items;
+	size_t len;
+	size_t size;
+} completions = { .lock = PTHREAD_MUTEX_INITIALIZER, .fd = -1 };
+// run time installs whose driver has answered or given up, waiting for the
+// main thread to attach them, which is woken through fd
+static struct
+{
+	pthread_mutex_t lock;
+	int fd;
+	struct pending_printer * done;
+} installs = { .lock = PTHREAD_MUTEX_INITIALIZER, .fd = -1 };
+// printers taken out of their groups whose threads have yet to finish the
+// job in hand, waited for before the server shuts down
+static struct
 {
-	// the head of the list
-	struct print_job * head;
-	// the number of jobs in the list
-	sem_t num_jobs;
-	// a lock for the list
 	pthread_mutex_t lock;
+	pthread_cond_t done;
+	int count;
+} leaving = { .lock = PTHREAD_MUTEX_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+// the clients submitting through shared memory rings, and the eventfd they
+// ring when the server is asleep; only touched by the main thread
+static struct
+{
+	int fd;
+	struct connection * head;
+} rings = { .fd = -1 };
+// when the server started and when statistics were last requested
+static uint64_t start_ns;
+static uint64_t last_stats_ns;
+
+/// the most events handled per call to epoll_wait()
+#define MAX_EVENTS 64
+/// the largest request a client may send before being disconnected
+#define MAX_REQUEST_SIZE (64 * 1024)
+/// the most unclaimed file descriptors a client may have in flight
+#define MAX_CLIENT_FDS 64
+/// the status a printer reports for a job it hands back to be queued again
+#define JOB_REDISPATCH 1
+/// the same, for a job it failed and has already counted as queued again
+#define JOB_REQUEUE 2
+
+/**
+ * A client connected to the server socket
+ */
+struct connection
+{
+	// the socket for this client
+	int fd;
+	// data received from the client that has not been parsed yet
+	char * buf;
+	// the number of bytes in buf
+	size_t len;
+	// the allocated size of buf
+	size_t size;
+	// the job this client is currently describing
+	struct print_job * job;
+	// the user on the other end of the socket
+	uid_t uid;
+	// 1 for a client using binary frames, -1 for the text protocol, 0 until
+	// the first byte arrives
+	int binary;
+	// job file descriptors received but not yet claimed by a frame
+	int fds[MAX_CLIENT_FDS];
+	int num_fds;
+	// the job this client is waiting on, or -1, and the next client waiting
+	// on the same job
+	long long wait_for;
+	struct connection * next_waiter;
+	// the printer install this client is waiting on, or NULL
+	struct pending_printer * installing;
+	// the submission ring this client shares, its size and number of slots
+	// as they were when it was opened, and the next client with a ring
+	struct psp_ring * ring;
+	size_t ring_size;
+	uint32_t ring_slots;
+	struct connection * next_ring;
+};
+
+/**
+ * A finished job reported by a printer thread to the main thread
+ */
+struct completion
+{
+	long long job_number;
+	int status;
 };
 
+// -- FUNCTION PROTOTYPES -- //
+static void parse_command_line(int argc, char * argv[]);
+static void parse_rc_file(FILE* fp);
+static int open_socket();
+static void accept_connections(int listen_fd, int epfd);
+static int read_connection(struct connection * c);
+static ssize_t recv_with_fds(struct connection * c, char * buf, size_t len);
+static int consume_lines(struct connection * c, int eof);
+static int consume_frames(struct connection * c);
+static int handle_frame(struct connection * c, const struct psp_frame * frame);
+static int submit_job(struct print_job * job);
+static void close_connection(struct connection * c);
+static void parse_line(struct connection * c, char * line);
+static void discard_job(struct print_job * job);
+static void build_group_table();
+static int find_group(const char * name, size_t len);
+static int list_printer_drivers();
+static void * printer_thread(void * arg);
+static int install_printer(struct connection * c, int group, char * location);
+static void finish_installs();
+static int uninstall_printer(int group, const char * name, size_t len);
+static void send_stats(struct connection * c);
+static void send_driver_list(struct connection * c, uint32_t epoch);
+static void send_result(struct connection * c, int32_t status, long long handle);
+static void send_result_fd(struct connection * c, int32_t status, long long handle, int pass_fd);
+static int read_submit(struct connection * c, uid_t owner, const struct psp_frame * frame, struct print_job ** out);
+static int open_ring(struct connection * c);
+static void service_rings();
+static int open_mqueue();
+static void service_mqueue();
+static void index_job(long long job_number, struct print_job * job);
+static void unindex_job(struct job_entry * e, int status);
+static int trusted_uid(uid_t uid);
+static int trusted_client(const struct connection * c);
+static int control_job(struct connection * c, int type, long long handle);
+static void wait_for_job(struct connection * c, long long handle);
+static void complete_job(long long job_number, int status);
+static void finish_jobs();
+static int recover_job(struct print_job * job, const char * group, size_t group_len, void * arg);
+static void redispatch_job(struct print_job * job, int requeued);
+static void stop_printers();
 /**
  * A printer object with associated thread
  */
@@ -72,8 +286,22 @@ struct printer
 	struct printer_driver driver;
 	// the list of jobs this printer can pull from
 	struct print_job_list * job_queue;
+	// the printer's own list, when its group hands each job to one printer
+	struct print_job_list own_queue;
+	// the bytes of the jobs on own_queue or being printed, and a moving
+	// average of how fast the printer prints in bytes per second
+	atomic_llong outstanding;
+	atomic_uint_least64_t rate;
 	// the thread id for this printer thread
 	pthread_t tid;
+	// what this printer has printed
+	struct printer_stats stats;
+	// jobs failed in a row, only touched by the printer's thread
+	int failures;
+	// set under leaving.lock once the printer is uninstalled
+	int leaving;
+	// the directory the driver writes its output to, or NULL if unknown
+	const char * output_dir;
 };
 
 /**
@@ -86,12 +314,40 @@ struct printer_group
 	struct printer_group * next_group;
 	// the name of this group
 	char * name;
+	// the index of this group in printer_groups, carried by its jobs
+	int index;
 	// the list of printers in this group
 	struct printer * printer_queue;
 	// the list of jobs for this group
 	struct print_job_list job_queue;
+	// 1 if each job goes to the printer expected to finish it first, onto
+	// that printer's own list; the group's list then only holds jobs while
+	// the group has no printers
+	int least_bytes;
+	// counters for the STATS request
+	struct group_stats stats;
+};
+
+/**
+ * A printer whose driver is being installed, from a PRINTER line of
+ * config.rc or an INSTALL_DRIVER request
+ */
+struct pending_printer
+{
+	struct printer * printer;
+	struct printer_group * group;
+	char * location;
+	pthread_t tid;
+	int started;
+	int rv;
+	// the client that asked for a run time install and waits for the
+	// answer, or NULL if it has gone; and the next finished install
+	struct connection * client;
+	struct pending_printer * next;
 };
 
+static int attach_printer(struct printer_group * g, struct printer * p);
+
 int main(int argc, char* argv[])
 {
 	if(argc > 1){
@@ -100,17 +356,16 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	int produce = 1;
-	int n_jobs = 0;
 	struct printer_group * g;
 	struct printer * p;
-	struct print_job * job;
-	struct print_job * prev = NULL;
-	char * line = NULL;
-	long long job_number = 0;
+	struct connection * c;
+	struct epoll_event events[MAX_EVENTS];
+	struct rlimit rlim;
+	int listen_fd, epfd, n, i;
 
 	// parse the command line arguments
 	//parse_command_line(argc, argv);
+	start_ns = last_stats_ns = stats_now_ns();
 
 	// open the runtime config file
 	FILE* config = fopen("config.rc", "r");
@@ -119,157 +374,180 @@ int main(int argc, char* argv[])
 	// close the config file
 	fclose(config);
 
+	// job events are written out by a thread of their own, so logging never
+	// holds up a client or a printer
+	if(job_log_open(&log_config))
+		eprintf("Job log disabled\n");
+	if(cache_config.path && output_cache_open(&cache_config))
+		eprintf("Output cache disabled\n");
+	if(mqueue.name && open_mqueue())
+		eprintf("Message queue disabled\n");
 
 	// order of opperation:
-	// 1. while the exit flag has not been set
-	// 2. read from standard in
-	// 3. do the necessary checks from standard in
-	// 4. if PRINT is received, go through each printer group, and check
-	//    to see if the group name matches what is specified by the job
-	// 5. Once a match is made, it puts the job in the job queue of the
-	//    correct printer group
-	// 6. then loop through the list of printer groups to get the print
-	//    job and send it to the printers
+	// 1. start one consumer thread per printer, each blocking on the job
+	//    queue of its printer group
+	// 2. open the listening socket once and hand it to an epoll instance
+	// 3. while the exit flag has not been set, wait for socket events
+	// 4. accept every pending client and read whatever each client sent,
+	//    parsing complete lines or frames on a per-client basis
+	// 5. if a job is submitted, look the group name it gives up in the
+	//    hash table of group names built at startup
+	// 6. put the job in the job queue of that printer group, or of the
+	//    printer chosen for it in a least bytes group, and wake a printer
+	// 7. once the exit flag is set, stop the printers, then close the
+	//    journal and logs they write to
+	for(g = printer_group_head; g; g = g->next_group)
+	{
+		// a job cancelled in a ring is only freed when a printer skips it
+		g->job_queue.release = discard_job;
+		// jobs are moved between the lists of a least bytes group, which a
+		// lock-free ring does not allow
+		if(g->least_bytes && g->job_queue.ops && g->job_queue.ops->erase == NULL)
+		{
+			eprintf("Group %s dispatches by least bytes, scheduling fcfs in place of %s\n", g->name, g->job_queue.ops->name);
+			g->job_queue.ops = &print_job_list_fifo;
+		}
+		if(print_job_list_init(&g->job_queue))
+		{
+			perror("print_job_list_init");
+			abort();
+		}
+		for(p = g->printer_queue; p; p = p->next)
+		{
+			if(attach_printer(g, p))
+			{
+				perror("print_job_list_init");
+				abort();
+			}
+		}
+	}
+	completions.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(completions.fd == -1)
+	{
+		perror("eventfd");
+		abort();
+	}
+	for(i = 0; i < RETIRED_JOBS; i++)
+		retired_jobs[i].job_number = -1;
+	// put back every job that was still queued when the server last stopped,
+	// before any client can add to the queues
+	if(journal_open(journal_path, journal_compact_bytes, recover_job, NULL, &job_number))
+		eprintf("Job journal disabled, queued jobs will not survive a restart\n");
 	for(g = printer_group_head; g; g = g->next_group)
 	{
-		sem_init(&g->job_queue.num_jobs, 0, 0);
+		for(p = g->printer_queue; p; p = p->next)
+		{
+			if(pthread_create(&p->tid, NULL, printer_thread, p))
+			{
+				perror("pthread_create");
+				abort();
+			}
+		}
+	}
+	if(list_printer_drivers())
+		abort();
+
+	// a client hanging up early must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	// every queued job holds its file open, allow as many as we are able
+	if(getrlimit(RLIMIT_NOFILE, &rlim) == 0)
+	{
+		rlim.rlim_cur = rlim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+	}
+
+	listen_fd = open_socket();
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(epfd == -1)
+	{
+		perror("epoll_create1");
+		exit(-1);
+	}
+	events[0].events = EPOLLIN;
+	events[0].data.ptr = NULL;
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &events[0]) == -1)
+	{
+		perror("epoll_ctl");
+		exit(-1);
+	}
+	// printers report finished jobs through an eventfd in the same loop
+	events[0].data.ptr = &completions;
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, completions.fd, &events[0]) == -1)
+	{
+		perror("epoll_ctl");
+		exit(-1);
+	}
+	// and so do the threads that install printers at run time
+	installs.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	events[0].data.ptr = &installs;
+	if(installs.fd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, installs.fd, &events[0]) == -1)
+	{
+		perror("eventfd");
+		exit(-1);
+	}
+	// and so do clients that submit through shared memory
+	rings.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	events[0].data.ptr = &rings;
+	if(rings.fd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, rings.fd, &events[0]) == -1)
+	{
+		perror("eventfd");
+		exit(-1);
+	}
+	// a message queue descriptor can be waited on like any other
+	events[0].data.ptr = &mqueue;
+	if(mqueue.q != (mqd_t)-1 && epoll_ctl(epfd, EPOLL_CTL_ADD, mqueue.q, &events[0]) == -1)
+	{
+		perror("epoll_ctl");
+		exit(-1);
 	}
-	char configBuf[1024] = ""; 
+
 	while(!exit_flag)
 	{
-		if(produce){
-			accept_socket();
-			char * temp;
-			temp = buffer;
-			//printf("\n\n\nwhat's in the buffer:\n\n%s\n\n", temp);
-			
-			while( (line = strsep(&temp,"\n")) != NULL ){
+		// from here on a client submitting through a ring rings the doorbell;
+		// anything submitted before it looked is picked up now
+		for(c = rings.head; c; c = c->next_ring)
+			__atomic_store_n(&c->ring->asleep, 1, __ATOMIC_SEQ_CST);
+		service_rings();
 
-				if(strncmp(line, "NEW", 3) == 0)
-				{
-					job = calloc(1, sizeof(struct print_job));
-					job->job_number = job_number++;
-					strcat(configBuf,"NEW JOB MADE\n");
-				}
-				else if(job && strncmp(line, "FILE", 4) == 0)
-				{
-					strsep(&line, " ");
-					size_t size = strlen(line);
-					job->file_name = malloc((size_t) size);
-					strncpy(job->file_name, line, size+1);
-					strcat(configBuf,"FILE ADDED TO JOB: ");
-					strcat(configBuf, job->file_name);
-					strcat(configBuf, "\n");
-				}
-				else if(job && strncmp(line, "NAME", 4) == 0)
-				{
-					strsep(&line, " ");
-					size_t size = strlen(line);
-					job->job_name = malloc((size_t) size);
-					strncpy(job->job_name, line, size+1);
-					strcat(configBuf,"NAME ADDED TO JOB: ");
-					strcat(configBuf, job->job_name);
-					strcat(configBuf, "\n");
-				}
-				else if(job && strncmp(line, "DESCRIPTION", 11) == 0)
-				{
-					strsep(&line, " ");
-					size_t size = strlen(line);
-					job->description = malloc((size_t) size);	
-					strncpy(job->description, line, size+1);
-					strcat(configBuf,"DESCRIPTION ADDED TO JOB: ");
-					strcat(configBuf, job->description);
-					strcat(configBuf, "\n");
-				}
-				else if(job && strncmp(line, "PRINTER", 7) == 0)
-				{
-					strsep(&line, " ");
-					size_t size = strlen(line);
-					job->group_name = malloc((size_t) size);	
-					strncpy(job->group_name, line, size+1);
-					strcat(configBuf,"PRINTER ADDED TO JOB: ");
-					strcat(configBuf, job->group_name);
-					strcat(configBuf, "\n");
-				}
-				else if(job && strncmp(line, "PRINT", 5) == 0)
-				{
-					if(!job->group_name)
-					{
-						eprintf("Trying to print without setting printer\n");
-						continue;
-					}
-					if(!job->file_name)
-					{
-						eprintf("Trying to print without providing input file\n");	
-						continue;
-					}
-					for(g = printer_group_head; g; g=g->next_group)
-					{
-						if(strcmp(job->group_name, g->name) == 0)
-						{
-							printf("Printing job in %s\n", job->group_name);
- 							job->next_job = g->job_queue.head;
- 							g->job_queue.head = job;
- 							sem_post(&g->job_queue.num_jobs);
-							
-							job = NULL;
-							produce = 0;
-							break;
-						}
-					}
-					if(job)
-					{
-						eprintf("Invalid printer group name given: %s\n", job->group_name);
-					}
-				}
-				else if(strncmp(line, "EXIT", 4) == 0)
-				{
-					exit_flag = 1;
-				}
-			}
-		}else{
-			for(g = printer_group_head; g; g = g->next_group){
-				for(p = g->printer_queue; p; p = p->next){
-					if(sem_getvalue(&p->job_queue->num_jobs, &n_jobs)){
-						perror("sem_getvalue");
-						abort();
-					}
-
-					if(n_jobs){
-						// wait for an item to be in the list
-	 					sem_wait(&p->job_queue->num_jobs);
-	 					// walk the list to the end
-	 					for(job = p->job_queue->head; job->next_job; prev = job, job = job->next_job);
-	 					if(prev)		
-	 						// fix the tail of the list
- 							prev->next_job = NULL;
- 						else
-							// There is only one item in the list
-							p->job_queue->head = NULL;
- 			
-	 					printf("consumed job %s\n", job->job_name);
- 		
- 						// send the job to the printer
-						printer_print(&p->driver, job);
-						produce = 1;
-					}
-				}
-			}
+		n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+		if(n == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			exit(-1);
+		}
+		for(i = 0; i < n; i++)
+		{
+			// the listening socket is registered without a connection
+			if(events[i].data.ptr == NULL)
+				accept_connections(listen_fd, epfd);
+			else if(events[i].data.ptr == &completions)
+				finish_jobs();
+			else if(events[i].data.ptr == &installs)
+				finish_installs();
+			else if(events[i].data.ptr == &rings)
+				service_rings();
+			else if(events[i].data.ptr == &mqueue)
+				service_mqueue();
+			else if(read_connection(events[i].data.ptr))
+				close_connection(events[i].data.ptr);
 		}
-			strcat(configBuf, "\n\n");
-			FILE *f = fopen("config.txt", "w");
-			if (f == NULL)
-			{
-				printf("Error opening file!\n");
-				exit(1);
-			}
 
-			/* print some text */
-			fprintf(f, "Print job:\n%s\n", configBuf);
-			fclose(f);
-			fflush(stdout);
+		fflush(stdout);
 	}
 
+	close(epfd);
+	close(listen_fd);
+	if(mqueue.q != (mqd_t)-1)
+		mq_close(mqueue.q);
+	unlink(socket_path);
+	// the printers journal and log the jobs they finish
+	stop_printers();
+	journal_close();
+	output_cache_close();
+	job_log_close();
 	return 0;
 }
 
@@ -298,150 +576,2235 @@ static void parse_command_line(int argc, char * argv[])
 	}
 }
 
-static void accept_socket(){
-	struct sockaddr_un addr;
-	char buf[2048];
-	int conSock,dataSock,rc;
-
-	socket_path="../socket";
+/**
+ * Log a printed job with its timestamps and the time it spent in each step:
+ * being submitted, waiting in the queue, starting to print, and printing.
+ */
+static void log_job_times(const struct print_job * job, const struct printer * p)
+{
+	job_log_printf("job %lld printed on %s accept_ns=%llu enqueue_ns=%llu dispatch_ns=%llu "
+		"first_byte_ns=%llu complete_ns=%llu submit_us=%.1f wait_us=%.1f start_us=%.1f "
+		"print_us=%.1f total_us=%.1f",
+		job->job_number, p->driver.name, job->accept_ns, job->enqueue_ns, job->dispatch_ns,
+		job->first_byte_ns, job->complete_ns,
+		(job->enqueue_ns - job->accept_ns) / 1e3, (job->dispatch_ns - job->enqueue_ns) / 1e3,
+		(job->first_byte_ns - job->dispatch_ns) / 1e3, (job->complete_ns - job->first_byte_ns) / 1e3,
+		(job->complete_ns - job->accept_ns) / 1e3);
+}
 
-	if ( (conSock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-		perror("socket error");
-		exit(-1);
+/**
+ * Set a printer up to take jobs from its group: from the group's list, or
+ * for a least bytes group from a list of its own under the group's policy.
+ * @return 0 on success, or -1 if the printer's list could not be made
+ */
+static int attach_printer(struct printer_group * g, struct printer * p)
+{
+	if(!g->least_bytes)
+	{
+		p->job_queue = &g->job_queue;
+		return 0;
 	}
+	p->own_queue.ops = g->job_queue.ops;
+	p->own_queue.capacity = g->job_queue.capacity;
+	p->own_queue.release = discard_job;
+	if(print_job_list_init(&p->own_queue))
+		return -1;
+	p->job_queue = &p->own_queue;
+	return 0;
+}
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
-	if (*socket_path == '\0') {
-		*addr.sun_path = '\0';
-		strncpy(addr.sun_path+1, socket_path+1, sizeof(addr.sun_path)-2);
-	} else {
-		strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path)-1);
-		unlink(socket_path);
-	}
+/**
+ * The printer whose own list a job was queued on, or NULL for a group's list
+ */
+static struct printer * list_owner(struct printer_group * g, struct print_job_list * list)
+{
+	if(list == &g->job_queue)
+		return NULL;
+	return (struct printer *)((char *)list - offsetof(struct printer, own_queue));
+}
 
-	if (bind(conSock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
-		perror("bind error");
-		exit(-1);
-	}
+/**
+ * Pick the printer of a least bytes group expected to finish a job first:
+ * the bytes it has yet to print and the job's, over how fast it prints.  A
+ * printer that has not printed yet is taken to be as fast as the fastest so
+ * it gets tried, but with one job at a time until it has been measured, and
+ * a tripped printer is only picked if all of them are.
+ * @return the printer, or NULL if the group has none
+ */
+static struct printer * least_loaded(struct printer_group * g, const struct print_job * job)
+{
+	struct printer * p;
+	struct printer * best = NULL;
+	uint64_t fastest = 0, rate;
+	double finish, best_finish = 0;
+	int tripped, best_tripped = 1;
 
-	if (listen(conSock, 5) == -1) {
-		perror("listen error");
-		exit(-1);
+	for(p = g->printer_queue; p; p = p->next)
+	{
+		rate = atomic_load_explicit(&p->rate, memory_order_relaxed);
+		if(rate > fastest)
+			fastest = rate;
 	}
-	int exiter = 0;
-	while (!exiter) {
-		if ( (dataSock = accept(conSock, 0, 0)) == -1) {
-			perror("accept error");
+	for(p = g->printer_queue; p; p = p->next)
+	{
+		rate = atomic_load_explicit(&p->rate, memory_order_relaxed);
+		if(rate == 0 && fastest && atomic_load_explicit(&p->outstanding, memory_order_relaxed))
 			continue;
+		if(rate == 0)
+			rate = fastest ? fastest : 1;
+		tripped = atomic_load_explicit(&p->stats.tripped, memory_order_relaxed);
+		finish = (double)(atomic_load_explicit(&p->outstanding, memory_order_relaxed) + job->size) / rate;
+		if(best == NULL || tripped < best_tripped || (tripped == best_tripped && finish < best_finish))
+		{
+			best = p;
+			best_finish = finish;
+			best_tripped = tripped;
 		}
-		while ( (rc=read(dataSock,buf,sizeof(buf))) > 0) {
-			exiter = 1;
-			break;
-		}
-		if (rc == -1) {
-			perror("read");
-			exit(-1);
-		}
-		else if (rc == 0) {
-			printf("EOF\n");
-		}
-	}
-	list_printer_drivers();
-	if(!strncmp(buf, "LIST_DRIVERS", 12)){
-		if(write(dataSock, listBuf, sizeof(listBuf)) != sizeof(listBuf)){
-			perror("write error");
-		}
-		close(conSock);
-		accept_socket();
-	}else{
-		strcpy(buffer, buf);
 	}
-	close(conSock);
+	return best;
 }
 
-static void list_printer_drivers(){
-	memset(listBuf, 0, 200);
-	struct printer_group * g;
-	struct printer * p;
-	for(g = printer_group_head; g; g=g->next_group){
-		for(p = g->printer_queue; p; p = p->next){
-			strcat(listBuf, p->driver.name);
-			strcat(listBuf, "|");	
-			strcat(listBuf, g->name);
-			strcat(listBuf, "\n");
-		}
-	}
+/**
+ * Put a job on its group's list, or for a least bytes group on the list of
+ * the printer expected to finish it first.  Only the main thread queues jobs
+ * this way, as it is the one that adds and removes printers.
+ * @param resume  1 to let a paused job be printed again instead
+ * @return 0 if the job was queued, or -1 if it was not
+ */
+static int queue_job(struct printer_group * g, struct print_job * job, int resume)
+{
+	struct printer * p = g->least_bytes ? least_loaded(g, job) : NULL;
+	struct print_job_list * list = p ? &p->own_queue : &g->job_queue;
+	int rv;
+
+	// counted first, the printer may finish the job as soon as it is pushed
+	if(p)
+		atomic_fetch_add_explicit(&p->outstanding, job->size, memory_order_relaxed);
+	job->assigned = list;
+	rv = resume ? print_job_list_resume(list, job) : print_job_list_push(list, job);
+	if(rv && p)
+		atomic_fetch_sub_explicit(&p->outstanding, job->size, memory_order_relaxed);
+	return rv;
 }
 
-static void parse_rc_file(FILE* fp)
+/**
+ * Queue every job waiting on a list again, on the lists of the printers of
+ * a least bytes group.  Only called by the main thread.
+ */
+static void move_jobs(struct printer_group * g, struct print_job_list * list)
 {
-	char * line = NULL;
-	char * ptr;
-	size_t n = 0;
-	struct printer_group * group = NULL;
-	struct printer_group * g;
-	struct printer * printer = NULL;
-	struct printer * p;
+	struct print_job * job;
 
-	// get each line of text from the config file
-	while(getline(&line, &n, fp) > 0)
+	while((job = print_job_list_take(list)))
+		redispatch_job(job, 0);
+}
+
+/**
+ * Hand the jobs waiting on a tripped printer's own list back to the main
+ * thread, which queues them on the other printers of the group.
+ */
+static void hand_back_jobs(struct printer * p)
+{
+	struct print_job * job;
+
+	while((job = print_job_list_take(&p->own_queue)))
 	{
-		// if the line is a comment
-		if(line[0] == '#')
-				continue;
+		atomic_fetch_sub_explicit(&p->outstanding, job->size, memory_order_relaxed);
+		complete_job(job->job_number, JOB_REDISPATCH);
+	}
+}
 
-		// If the line is defining a new printer group
-		if(strncmp(line, "PRINTER_GROUP", 13) == 0)
-		{
-			strtok(line, " ");
-			ptr = strtok(NULL, "\n");
-			group = calloc(1, sizeof(struct printer_group));
-			group->name = malloc(strlen(ptr)+1);
-			strcpy(group->name, ptr);
+/**
+ * Fold the speed of a printed job into the printer's moving average, each
+ * job counting for a quarter.
+ */
+static void update_rate(struct printer * p, const struct print_job * job)
+{
+	uint64_t rate = atomic_load_explicit(&p->rate, memory_order_relaxed);
+	uint64_t sample;
 
-			if(printer_group_head)
-			{
-				for(g = printer_group_head; g->next_group; g=g->next_group);
-				g->next_group = group;
-			}
-			else
-			{
-				printer_group_head = group;
-			}
-		}
-		// If the line is defining a new printer
-		else if(strncmp(line, "PRINTER", 7) == 0)
-		{
-			strtok(line, " ");
-			ptr = strtok(NULL, "\n");
-			printer = calloc(1, sizeof(struct printer));
-			printer_install(&printer->driver, ptr);
-			printer->job_queue =  &(group->job_queue);
-			if(group->printer_queue)
-			{
-				for(p = group->printer_queue; p->next; p = p->next);
-				p->next = printer;
-			}
-			else
-			{
-					group->printer_queue = printer;
+	if(job->complete_ns <= job->dispatch_ns)
+		return;
+	sample = (uint64_t)((double)job->size * 1e9 / (job->complete_ns - job->dispatch_ns));
+	if(sample == 0)
+		sample = 1;
+	rate = rate ? rate - rate / 4 + sample / 4 : sample;
+	atomic_store_explicit(&p->rate, rate, memory_order_relaxed);
+}
 
-			}
-		}
+/**
+ * Keep a tripped printer off the queue until its driver answers again,
+ * trying it once per cooldown.  The printer may be uninstalled meanwhile.
+ */
+static void recover_printer(struct printer * p)
+{
+	struct timespec cooldown = { driver_cooldown_ms / 1000, driver_cooldown_ms % 1000 * 1000000L };
+	int cancel_state;
+
+	do
+	{
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &cancel_state);
+		nanosleep(&cooldown, NULL);
+		pthread_setcancelstate(cancel_state, NULL);
 	}
+	while(printer_recover(&p->driver));
+	p->failures = 0;
+	atomic_store_explicit(&p->stats.tripped, 0, memory_order_relaxed);
+	job_log_printf("printer %s recovered", p->driver.name);
+}
 
-	// print out the printer groups
-	dprintf("\n--- Printers ---\n"); 
-	for(g = printer_group_head; g; g = g->next_group)
+/**
+ * Put a job that a printer failed back on its group's queue, so another
+ * printer of the group can print it, unless it has failed too often.
+ * @return 1 if the job was requeued, or 0 if it has failed for good
+ */
+static int requeue_job(struct printer_group * g, struct print_job * job)
+{
+	if(job->attempts >= driver_retries)
+		return 0;
+	job->attempts++;
+	job->first_byte_ns = 0;
+	job->complete_ns = 0;
+	job->enqueue_ns = stats_now_ns();
+	// logged and counted first, another printer may take the job at once
+	job_log_printf("job %lld requeued in %s", job->job_number, g->name);
+	atomic_fetch_add_explicit(&g->stats.enqueued, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&g->stats.requeued, 1, memory_order_relaxed);
+	// only the main thread picks a printer of a least bytes group
+	if(g->least_bytes)
 	{
-		dprintf("Printer Group %s\n", g->name);
-		for(p = g->printer_queue; p; p = p->next)
-		{
-			dprintf("\tPrinter %s\n", p->driver.name);
-		}
+		complete_job(job->job_number, JOB_REQUEUE);
+		return 1;
 	}
-	dprintf("----------------\n\n");
+	if(print_job_list_push(&g->job_queue, job))
+	{
+		atomic_fetch_sub_explicit(&g->stats.enqueued, 1, memory_order_relaxed);
+		atomic_fetch_sub_explicit(&g->stats.requeued, 1, memory_order_relaxed);
+		return 0;
+	}
+	return 1;
+}
 
+/**
+ * Whether the driver writes a job's output to a file by the job's name.
+ * The name is cut at a space or colon by the driver, and must not leave the
+ * output directory.
+ */
+static int cacheable_name(const char * name)
+{
+	return name && *name && strcmp(name, ".") != 0 && strcmp(name, "..") != 0 && strpbrk(name, "/: \n") == NULL;
 }
 
+/**
+ * Wait until no other printer is writing an output to path, then claim it
+ * until release_output().  Printers sharing an output directory then print
+ * jobs of the same name one after the other, and each output is cached as
+ * its own job left it.
+ */
+static void claim_output(struct output_claim * claim, const char * path)
+{
+	struct output_claim * c;
+
+	claim->path = path;
+	pthread_mutex_lock(&output_claims_lock);
+	for(c = output_claims; c; )
+	{
+		if(strcmp(c->path, path) == 0)
+		{
+			pthread_cond_wait(&output_claims_freed, &output_claims_lock);
+			c = output_claims;
+		}
+		else
+		{
+			c = c->next;
+		}
+	}
+	claim->next = output_claims;
+	output_claims = claim;
+	pthread_mutex_unlock(&output_claims_lock);
+}
+
+static void release_output(struct output_claim * claim)
+{
+	struct output_claim ** c;
+
+	pthread_mutex_lock(&output_claims_lock);
+	for(c = &output_claims; *c != claim; c = &(*c)->next);
+	*c = claim->next;
+	pthread_cond_broadcast(&output_claims_freed);
+	pthread_mutex_unlock(&output_claims_lock);
+}
+
+/**
+ * Print a job, unless the printer has printed the same file before and the
+ * output cache still holds what it made, which is then copied out in its
+ * place without troubling the driver.
+ * @param reused  set to 1 if the output came from the cache
+ * @return what printer_print() returns
+ */
+static int print_or_reuse(struct printer * p, struct print_job * job, int * reused)
+{
+	unsigned char key[OUTPUT_CACHE_KEY];
+	struct output_claim claim;
+	char path[4096];
+	int fd, keyed, rv;
+
+	*reused = 0;
+	if(!output_cache_enabled() || p->output_dir == NULL || !cacheable_name(job->job_name))
+		return printer_print(&p->driver, job);
+	fd = job->fd != -1 ? job->fd : open(job->file_name, O_RDONLY | O_CLOEXEC);
+	keyed = fd != -1 && output_cache_key(fd, p->driver.name, key) == 0;
+	if(fd != -1 && fd != job->fd)
+		close(fd);
+	snprintf(path, sizeof(path), "%s/%s", p->output_dir, job->job_name);
+	claim_output(&claim, path);
+	if(keyed && output_cache_fetch(key, path) == 0)
+	{
+		release_output(&claim);
+		job->first_byte_ns = job->complete_ns = stats_now_ns();
+		*reused = 1;
+		return PRINTER_OK;
+	}
+	rv = printer_print(&p->driver, job);
+	if(rv == PRINTER_OK && keyed)
+		output_cache_store(key, path);
+	release_output(&claim);
+	return rv;
+}
+
+/**
+ * Release a printer that has been uninstalled.  Run by the printer's own
+ * thread as it is cancelled, which only happens while it waits for a job.
+ */
+static void printer_detached(void * arg)
+{
+	struct printer * p = arg;
+
+	printer_uninstall(&p->driver);
+	// uninstall_printer already moved the jobs on the printer's own list
+	if(p->job_queue == &p->own_queue)
+		print_job_list_destroy(&p->own_queue);
+	pthread_mutex_lock(&leaving.lock);
+	if(p->leaving && --leaving.count == 0)
+		pthread_cond_broadcast(&leaving.done);
+	pthread_mutex_unlock(&leaving.lock);
+	free(p);
+}
+
+/**
+ * The consumer thread for a single printer.  Each printer blocks on the job
+ * queue of its group and prints jobs as they become available, so every
+ * printer in the system can be busy at the same time while the main thread
+ * keeps accepting new jobs.
+ */
+static void * printer_thread(void * arg)
+{
+	struct printer * p = arg;
+	struct printer_group * g;
+	struct print_job * job;
+	int rv, reused;
+
+	// an uninstalled printer finishes the job in hand, it is only cancelled
+	// once it goes back to the queue for another
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_cleanup_push(printer_detached, p);
+	while(1)
+	{
+		if(atomic_load_explicit(&p->stats.tripped, memory_order_relaxed))
+			recover_printer(p);
+
+		// wait for the oldest job in the group
+		job = print_job_list_pop(p->job_queue);
+		job->dispatch_ns = stats_now_ns();
+		g = printer_groups[job->group];
+		atomic_fetch_add_explicit(&g->stats.dequeued, 1, memory_order_relaxed);
+		histogram_record(&g->stats.wait, job->dispatch_ns - job->enqueue_ns);
+
+		printf("consumed job %s\n", job->job_name);
+		fflush(stdout);
+		job_log_printf("job %lld printing on %s", job->job_number, p->driver.name);
+		journal_dispatched(job->job_number);
+
+		// send the job to the printer
+		rv = print_or_reuse(p, job, &reused);
+		if(job->complete_ns == 0)
+			job->complete_ns = stats_now_ns();
+		if(p->job_queue == &p->own_queue)
+			atomic_fetch_sub_explicit(&p->outstanding, job->size, memory_order_relaxed);
+		histogram_record(&g->stats.print, job->complete_ns - job->dispatch_ns);
+		atomic_fetch_add_explicit(&p->stats.busy_ns, job->complete_ns - job->dispatch_ns, memory_order_relaxed);
+		if(rv)
+		{
+			job_log_printf("job %lld failed on %s", job->job_number, p->driver.name);
+			atomic_fetch_add_explicit(&p->stats.failed, 1, memory_order_relaxed);
+		}
+		else
+		{
+			log_job_times(job, p);
+			atomic_fetch_add_explicit(&p->stats.jobs, 1, memory_order_relaxed);
+			atomic_fetch_add_explicit(&p->stats.bytes, job->size, memory_order_relaxed);
+			// a copied output says nothing of how fast the printer prints
+			if(reused)
+				atomic_fetch_add_explicit(&p->stats.cache_hits, 1, memory_order_relaxed);
+			else
+				update_rate(p, job);
+			p->failures = 0;
+		}
+		// a driver that timed out or went away is tripped at once, one
+		// that answers but keeps failing jobs once it has failed enough of
+		// them in a row; a job whose own file let it down counts for
+		// neither, or a user could take a group offline by truncating files
+		if(rv && (p->driver.broken || (!p->driver.bad_file && ++p->failures >= driver_failures)))
+		{
+			atomic_store_explicit(&p->stats.tripped, 1, memory_order_relaxed);
+			job_log_printf("printer %s tripped", p->driver.name);
+			if(p->job_queue == &p->own_queue)
+				hand_back_jobs(p);
+		}
+		// only a job the driver never answered for may print elsewhere
+		if(rv == PRINTER_DRIVER_FAILED && requeue_job(g, job))
+			continue;
+		journal_finished(job->job_number);
+		complete_job(job->job_number, rv);
+		if(job->fd != -1)
+			close(job->fd);
+		job_pool_free(job);
+	}
+	pthread_cleanup_pop(0);
+
+	return NULL;
+}
+
+/**
+ * Install the driver of an INSTALL_DRIVER request, then hand the install
+ * to the main thread to finish
+ */
+static void * hotplug_thread(void * arg)
+{
+	struct pending_printer * pending = arg;
+	uint64_t one = 1;
+
+	pending->rv = printer_install(&pending->printer->driver, pending->location);
+	pthread_mutex_lock(&installs.lock);
+	pending->next = installs.done;
+	installs.done = pending;
+	pthread_mutex_unlock(&installs.lock);
+	if(write(installs.fd, &one, sizeof(one)) != sizeof(one))
+		perror("eventfd write");
+	return NULL;
+}
+
+/**
+ * Hot-plug a printer driver into a group.  The driver must already be
+ * running.  The install handshake runs on a thread of its own, as a driver
+ * may take up to its install timeout to answer, and the client is answered
+ * by finish_installs() once it is done.
+ * @param location  the driver's fifos, taken over by the install
+ * @return 0 if the install has started, or -1 if it could not be
+ */
+static int install_printer(struct connection * c, int group, char * location)
+{
+	struct pending_printer * pending;
+
+	// one install at a time per client
+	if(c->installing)
+	{
+		free(location);
+		return -1;
+	}
+	// opening the fifo of a driver that is not running would only wait out
+	// the install timeout, so fail straight away
+	if(!printer_running(location))
+	{
+		eprintf("Printer driver %s is not running\n", location);
+		free(location);
+		return -1;
+	}
+	pending = calloc(1, sizeof(struct pending_printer));
+	if(pending)
+		pending->printer = calloc(1, sizeof(struct printer));
+	if(pending == NULL || pending->printer == NULL)
+	{
+		perror("calloc");
+		free(pending);
+		free(location);
+		return -1;
+	}
+	pending->printer->driver.write_timeout_ms = driver_write_timeout_ms;
+	pending->printer->driver.ack_timeout_ms = driver_ack_timeout_ms;
+	pending->printer->driver.install_timeout_ms = driver_install_timeout_ms;
+	pending->printer->output_dir = output_dir;
+	pending->group = printer_groups[group];
+	pending->location = location;
+	pending->client = c;
+	if(pthread_create(&pending->tid, NULL, hotplug_thread, pending))
+	{
+		perror("pthread_create");
+		free(pending->printer);
+		free(pending);
+		free(location);
+		return -1;
+	}
+	pthread_detach(pending->tid);
+	c->installing = pending;
+	return 0;
+}
+
+/**
+ * Put a printer whose driver answered its install into its group
+ * @return 0 if the printer joined the group, or -1 if it did not
+ */
+static int join_group(struct printer_group * g, struct printer * printer)
+{
+	struct printer ** p;
+
+	if(attach_printer(g, printer))
+		return -1;
+	if(pthread_create(&printer->tid, NULL, printer_thread, printer))
+	{
+		perror("pthread_create");
+		// nothing has been queued on the printer's own list yet
+		if(printer->job_queue == &printer->own_queue)
+			print_job_list_destroy(&printer->own_queue);
+		return -1;
+	}
+
+	for(p = &g->printer_queue; *p; p = &(*p)->next);
+	*p = printer;
+	list_printer_drivers();
+	job_log_printf("printer %s installed in %s", printer->driver.name, g->name);
+	// jobs that came while a least bytes group had no printers
+	if(g->least_bytes)
+		move_jobs(g, &g->job_queue);
+	return 0;
+}
+
+/**
+ * Finish the run time installs whose threads are done, and answer the
+ * clients that asked for them
+ */
+static void finish_installs()
+{
+	struct pending_printer * pending;
+	struct pending_printer * next;
+	uint64_t count;
+	int status;
+
+	if(read(installs.fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+		perror("eventfd read");
+	pthread_mutex_lock(&installs.lock);
+	pending = installs.done;
+	installs.done = NULL;
+	pthread_mutex_unlock(&installs.lock);
+
+	for(; pending; pending = next)
+	{
+		next = pending->next;
+		status = pending->rv;
+		if(status == 0 && (status = join_group(pending->group, pending->printer)))
+			printer_uninstall(&pending->printer->driver);
+		if(status)
+			free(pending->printer);
+		if(pending->client)
+		{
+			pending->client->installing = NULL;
+			send_result(pending->client, status, -1);
+		}
+		free(pending->location);
+		free(pending);
+	}
+}
+
+/**
+ * Take a printer out of its group.  A printer in the middle of a job
+ * finishes it first, then its thread releases the driver.
+ * @param group  the printer's group, or -1 to look in every group
+ * @return 0 if the printer was uninstalled, or -1 if there is no such printer
+ */
+static int uninstall_printer(int group, const char * name, size_t len)
+{
+	struct printer_group * g;
+	struct printer ** p;
+	struct printer * printer;
+
+	for(g = printer_group_head; g; g = g->next_group)
+	{
+		if(group != -1 && g->index != group)
+			continue;
+		for(p = &g->printer_queue; (printer = *p); p = &printer->next)
+		{
+			if(strncmp(printer->driver.name, name, len) == 0 && printer->driver.name[len] == '\0')
+			{
+				*p = printer->next;
+				list_printer_drivers();
+				job_log_printf("printer %s uninstalled from %s", printer->driver.name, g->name);
+				// the jobs waiting on the printer go to the rest of the group
+				if(printer->job_queue == &printer->own_queue)
+					move_jobs(g, &printer->own_queue);
+				pthread_mutex_lock(&leaving.lock);
+				printer->leaving = 1;
+				leaving.count++;
+				pthread_mutex_unlock(&leaving.lock);
+				// the thread frees the printer, it must not be touched after
+				pthread_detach(printer->tid);
+				pthread_cancel(printer->tid);
+				return 0;
+			}
+		}
+	}
+	return -1;
+}
+
+/**
+ * Stop every printer thread, those uninstalled included.  A printer finishes
+ * the job in hand and is cancelled as it goes back for another, so every job
+ * it took is journaled and logged before the journal and logs are closed.
+ */
+static void stop_printers()
+{
+	struct printer_group * g;
+	struct printer * p;
+	pthread_t * tids, tid;
+	size_t count = 0, i;
+
+	for(g = printer_group_head; g; g = g->next_group)
+		for(p = g->printer_queue; p; p = p->next)
+			count++;
+	// cancel them all before joining any, so they finish their jobs at once;
+	// without the memory for that, one at a time
+	tids = malloc(count * sizeof(pthread_t));
+	i = 0;
+	for(g = printer_group_head; g; g = g->next_group)
+	{
+		while((p = g->printer_queue))
+		{
+			// the thread frees the printer once cancelled
+			g->printer_queue = p->next;
+			tid = p->tid;
+			pthread_cancel(tid);
+			if(tids)
+				tids[i++] = tid;
+			else
+				pthread_join(tid, NULL);
+		}
+	}
+	if(tids)
+	{
+		for(i = 0; i < count; i++)
+			pthread_join(tids[i], NULL);
+		free(tids);
+	}
+
+	pthread_mutex_lock(&leaving.lock);
+	while(leaving.count)
+		pthread_cond_wait(&leaving.done, &leaving.lock);
+	pthread_mutex_unlock(&leaving.lock);
+}
+
+/**
+ * Create, bind and listen on the server socket.  This is done once at startup
+ * so that clients never find the socket missing between two requests.
+ */
+static int open_socket()
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	socket_path="../socket";
+
+	if ( (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+		perror("socket error");
+		exit(-1);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (*socket_path == '\0') {
+		*addr.sun_path = '\0';
+		strncpy(addr.sun_path+1, socket_path+1, sizeof(addr.sun_path)-2);
+	} else {
+		strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path)-1);
+		unlink(socket_path);
+	}
+
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		perror("bind error");
+		exit(-1);
+	}
+
+	if (listen(fd, SOMAXCONN) == -1) {
+		perror("listen error");
+		exit(-1);
+	}
+	return fd;
+}
+
+/**
+ * Accept every client waiting on the listening socket and register each one
+ * with the event loop.
+ */
+static void accept_connections(int listen_fd, int epfd)
+{
+	struct epoll_event ev;
+	struct connection * c;
+	struct ucred cred;
+	socklen_t len;
+	int fd;
+
+	while((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+	{
+		c = calloc(1, sizeof(struct connection));
+		c->fd = fd;
+		c->wait_for = -1;
+		len = sizeof(cred);
+		if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+			c->uid = cred.uid;
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = c;
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+		{
+			perror("epoll_ctl");
+			close_connection(c);
+		}
+	}
+	if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		perror("accept error");
+}
+
+/**
+ * Read everything a client has sent so far and handle each complete request.
+ * @return 0 if the connection should stay open, -1 once it should be closed
+ */
+static int read_connection(struct connection * c)
+{
+	size_t limit;
+	ssize_t rc;
+
+	while(1)
+	{
+		if(c->len + 1 >= c->size)
+		{
+			limit = c->binary ? PSP_HEADER_SIZE + PSP_MAX_FRAME : MAX_REQUEST_SIZE;
+			if(c->size >= limit)
+			{
+				eprintf("Request too long, dropping client\n");
+				return -1;
+			}
+			c->size = c->size ? c->size * 2 : 2048;
+			c->buf = realloc(c->buf, c->size);
+		}
+		rc = recv_with_fds(c, c->buf + c->len, c->size - c->len - 1);
+		if(rc > 0)
+		{
+			// the first byte tells a binary client from a text one
+			if(c->len == 0 && c->binary == 0)
+				c->binary = ((unsigned char)c->buf[0] == (PSP_MAGIC >> 24)) ? 1 : -1;
+			c->len += rc;
+			if((c->binary > 0 ? consume_frames(c) : consume_lines(c, 0)))
+				return -1;
+			continue;
+		}
+		if(rc == -1 && errno == EINTR)
+			continue;
+		if(rc == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			perror("read");
+			return -1;
+		}
+		break;
+	}
+
+	// the client hung up
+	if(rc == 0)
+	{
+		if(c->binary < 0)
+			consume_lines(c, 1);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Read from a client, keeping any file descriptors it passed along with the
+ * data in the order they arrived.
+ * @return the number of bytes read, 0 on end of file, or -1 on error
+ */
+static ssize_t recv_with_fds(struct connection * c, char * buf, size_t len)
+{
+	union {
+		char buf[CMSG_SPACE(MAX_CLIENT_FDS * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov = { buf, len };
+	struct msghdr msg;
+	struct cmsghdr * cmsg;
+	ssize_t rc;
+	int * fds;
+	int i, n;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	rc = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+	if(rc <= 0)
+		return rc;
+
+	for(cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		fds = (int*)CMSG_DATA(cmsg);
+		n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for(i = 0; i < n; i++)
+		{
+			if(c->num_fds < MAX_CLIENT_FDS)
+				c->fds[c->num_fds++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+	return rc;
+}
+
+/**
+ * Parse each complete line a text mode client has sent.
+ * @param eof non-zero if the client has hung up and a final unterminated line
+ *            should be handled as well
+ * @return 0
+ */
+static int consume_lines(struct connection * c, int eof)
+{
+	char * line;
+	char * end;
+
+	c->buf[c->len] = '\0';
+	line = c->buf;
+	while((end = memchr(line, '\n', c->len - (line - c->buf))))
+	{
+		*end = '\0';
+		parse_line(c, line);
+		line = end + 1;
+	}
+	c->len -= line - c->buf;
+	memmove(c->buf, line, c->len);
+	c->buf[c->len] = '\0';
+
+	// older clients do not terminate their final command with a newline
+	if(eof || strcmp(c->buf, "PRINT") == 0 || strcmp(c->buf, "LIST_DRIVERS") == 0)
+	{
+		if(c->len)
+			parse_line(c, c->buf);
+		c->len = 0;
+	}
+	return 0;
+}
+
+/**
+ * Handle each complete frame a binary client has sent.
+ * @return 0, or -1 if the client sent something that is not a valid frame
+ */
+static int consume_frames(struct connection * c)
+{
+	struct psp_frame frame;
+	size_t off = 0;
+	long n;
+
+	while((n = psp_parse_frame(c->buf + off, c->len - off, &frame)) > 0)
+	{
+		if(handle_frame(c, &frame))
+			return -1;
+		off += n;
+	}
+	if(n < 0)
+	{
+		eprintf("Malformed frame, dropping client\n");
+		return -1;
+	}
+	c->len -= off;
+	memmove(c->buf, c->buf + off, c->len);
+	return 0;
+}
+
+/**
+ * Send a reply frame made of a single field to a binary client.
+ */
+static void send_reply(struct connection * c, uint8_t type, uint16_t tag, const void * data, uint32_t length)
+{
+	char head[PSP_HEADER_SIZE + PSP_FIELD_HEADER_SIZE];
+	struct iovec iov[2];
+	char * p;
+
+	p = psp_put_header(head, type, PSP_FIELD_HEADER_SIZE + length);
+	p = psp_put_u16(p, tag);
+	p = psp_put_u16(p, 0);
+	psp_put_u32(p, length);
+	iov[0].iov_base = head;
+	iov[0].iov_len = sizeof(head);
+	iov[1].iov_base = (void*)data;
+	iov[1].iov_len = length;
+	if(writev(c->fd, iov, 2) != (ssize_t)(sizeof(head) + length))
+		perror("write error");
+}
+
+/**
+ * Handle one request frame from a binary client.  The fields are read in
+ * place from the receive buffer.
+ * @return 0, or -1 if the frame is malformed
+ */
+static int handle_frame(struct connection * c, const struct psp_frame * frame)
+{
+	struct psp_field field;
+	struct print_job * job;
+	long long handle;
+	const char * name;
+	char * location;
+	size_t name_len;
+	uint32_t off = 0;
+	uint32_t epoch = 0;
+	int32_t status;
+	int group;
+	int rv;
+
+	switch(frame->type)
+	{
+		case PSP_SUBMIT:
+			rv = read_submit(c, c->uid, frame, &job);
+			if(rv < 0)
+				return -1;
+			if(rv == 0)
+			{
+				send_result(c, -1, -1);
+				break;
+			}
+			handle = job->job_number;
+			status = submit_job(job);
+			send_result(c, status, status == 0 ? handle : -1);
+			break;
+		case PSP_JOB_STATUS:
+		case PSP_WAIT:
+		case PSP_CANCEL:
+		case PSP_PAUSE:
+		case PSP_RESUME:
+			handle = -1;
+			while((rv = psp_next_field(frame, &off, &field)) > 0)
+			{
+				if(field.tag == PSP_HANDLE && field.length == 4)
+					handle = psp_get_u32(field.data);
+			}
+			if(rv < 0)
+				return -1;
+			if(handle < 0 || handle >= job_number)
+				send_result(c, -1, handle);
+			else if(frame->type == PSP_JOB_STATUS)
+				send_result(c, job_index_find(&job_index, handle) ? 0 : 1, handle);
+			else if(frame->type == PSP_WAIT)
+				wait_for_job(c, handle);
+			else
+				send_result(c, control_job(c, frame->type, handle), handle);
+			break;
+		case PSP_INSTALL_DRIVER:
+		case PSP_UNINSTALL_DRIVER:
+			group = -1;
+			name = NULL;
+			name_len = 0;
+			while((rv = psp_next_field(frame, &off, &field)) > 0)
+			{
+				if(field.tag == PSP_PRINTER)
+				{
+					group = find_group(field.data, field.length);
+					if(group < 0)
+						eprintf("Invalid printer group name given: %.*s\n", (int)field.length, field.data);
+				}
+				else if(field.tag == PSP_DRIVER || field.tag == PSP_NAME)
+				{
+					name = field.data;
+					name_len = field.length;
+				}
+			}
+			if(rv < 0)
+				return -1;
+			// only the server's own user may change its printers
+			if(name == NULL || !trusted_client(c))
+				status = -1;
+			else if(frame->type == PSP_UNINSTALL_DRIVER)
+				status = uninstall_printer(group, name, name_len);
+			else if(group < 0)
+				status = -1;
+			else
+			{
+				// answered once the driver has been installed
+				location = strndup(name, name_len);
+				status = install_printer(c, group, location);
+				if(status == 0)
+					break;
+			}
+			send_result(c, status, -1);
+			break;
+		case PSP_LIST_DRIVERS:
+			while((rv = psp_next_field(frame, &off, &field)) > 0)
+			{
+				if(field.tag == PSP_EPOCH && field.length == 4)
+					epoch = psp_get_u32(field.data);
+			}
+			if(rv < 0)
+				return -1;
+			send_driver_list(c, epoch);
+			break;
+		case PSP_STATS:
+			send_stats(c);
+			break;
+		case PSP_OPEN_RING:
+			send_result_fd(c, open_ring(c), -1, rings.fd);
+			break;
+		case PSP_EXIT:
+			if(trusted_client(c))
+				exit_flag = 1;
+			else
+			{
+				eprintf("Refusing EXIT from uid %u\n", (unsigned)c->uid);
+			}
+			break;
+		default:
+			eprintf("Unknown request type %d\n", frame->type);
+			break;
+	}
+	return 0;
+}
+
+/**
+ * Make a job out of a SUBMIT frame.  A job without a FILE_FD has its file
+ * opened by the server, with the server's permissions, so only a trusted
+ * client may leave it out, as for the ring and the message queue.
+ * @param c      the client whose descriptors came with the frame, or NULL
+ *               for the message queue, which only trusted users can open
+ * @param owner  the user the job is printed for
+ * @param out    set to the job
+ * @return 1 if the job was made, 0 if there was no memory for it or it was
+ *         refused, or -1 if the frame is malformed
+ */
+static int read_submit(struct connection * c, uid_t owner, const struct psp_frame * frame, struct print_job ** out)
+{
+	struct psp_field field;
+	struct print_job * job;
+	uint32_t off = 0;
+	int rv;
+
+	job = job_pool_alloc();
+	if(job == NULL)
+	{
+		eprintf("Out of memory for a new job\n");
+		return 0;
+	}
+	job->accept_ns = stats_now_ns();
+	job->job_number = job_number++;
+	job->owner = owner;
+	while((rv = psp_next_field(frame, &off, &field)) > 0)
+	{
+		switch(field.tag)
+		{
+			case PSP_PRINTER:
+				job->group = find_group(field.data, field.length);
+				if(job->group < 0)
+					eprintf("Invalid printer group name given: %.*s\n", (int)field.length, field.data);
+				break;
+			case PSP_NAME:
+				job_pool_set_string(job, &job->job_name, field.data, field.length);
+				break;
+			case PSP_DESCRIPTION:
+				job_pool_set_string(job, &job->description, field.data, field.length);
+				break;
+			case PSP_FILE:
+				job_pool_set_string(job, &job->file_name, field.data, field.length);
+				break;
+			case PSP_FILE_FD:
+				// the descriptor travelled alongside the frame
+				if(c && c->num_fds)
+				{
+					if(job->fd != -1)
+						close(job->fd);
+					job->fd = c->fds[0];
+					memmove(c->fds, c->fds + 1, --c->num_fds * sizeof(int));
+				}
+				break;
+			case PSP_PRIORITY:
+				if(field.length == 4)
+					job->priority = (int32_t)psp_get_u32(field.data);
+				break;
+		}
+	}
+	if(rv < 0)
+	{
+		discard_job(job);
+		return -1;
+	}
+	if(c && job->fd == -1 && !trusted_client(c))
+	{
+		eprintf("Refusing a job without a file descriptor from uid %u\n", (unsigned)c->uid);
+		job_log_printf("job %lld rejected: no file descriptor from uid %u", job->job_number, (unsigned)c->uid);
+		discard_job(job);
+		return 0;
+	}
+	*out = job;
+	return 1;
+}
+
+/**
+ * Map the submission ring a client passed with OPEN_RING.  A ring job's
+ * file is opened by the server, so only a client running as the server's
+ * user, or root, may have one; the ring must be sealed against shrinking so
+ * the client cannot pull it out from under the server.
+ * @return 0 if the ring is open, or -1 if it was refused
+ */
+static int open_ring(struct connection * c)
+{
+	struct psp_ring * ring;
+	struct stat st;
+	uint32_t slots;
+	int fd, seals;
+
+	if(c->ring || c->num_fds == 0)
+		return -1;
+	fd = c->fds[0];
+	memmove(c->fds, c->fds + 1, --c->num_fds * sizeof(int));
+	seals = fcntl(fd, F_GET_SEALS);
+	if(!trusted_client(c) || seals == -1 || !(seals & F_SEAL_SHRINK) ||
+		fstat(fd, &st) || (size_t)st.st_size < sizeof(struct psp_ring))
+	{
+		close(fd);
+		return -1;
+	}
+	ring = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ring == MAP_FAILED)
+		return -1;
+	// the slot count is read once, the client may change it afterwards
+	slots = __atomic_load_n(&ring->slots, __ATOMIC_RELAXED);
+	if(ring->magic != PSP_RING_MAGIC || slots == 0 || slots > PSP_RING_MAX_SLOTS ||
+		sizeof(struct psp_ring) + slots * sizeof(struct psp_ring_slot) > (size_t)st.st_size)
+	{
+		munmap(ring, st.st_size);
+		return -1;
+	}
+	c->ring = ring;
+	c->ring_size = st.st_size;
+	c->ring_slots = slots;
+	c->next_ring = rings.head;
+	rings.head = c;
+	return 0;
+}
+
+/**
+ * Take every job waiting in the submission rings.  A frame is copied out of
+ * shared memory before it is looked at, as the client could change it under
+ * us; anything but a well formed SUBMIT fails.
+ */
+static void service_rings()
+{
+	static char buf[PSP_RING_FRAME];
+	struct psp_ring_slot * slot;
+	struct psp_frame frame;
+	struct print_job * job;
+	struct connection * c;
+	uint64_t count;
+	uint32_t i, len;
+	int32_t status;
+	long long handle;
+
+	if(read(rings.fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+		perror("eventfd read");
+	for(c = rings.head; c; c = c->next_ring)
+	{
+		for(i = 0; i < c->ring_slots; i++)
+		{
+			slot = &c->ring->slot[i];
+			if(__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != PSP_SLOT_SUBMITTED)
+				continue;
+			len = __atomic_load_n(&slot->length, __ATOMIC_RELAXED);
+			if(len > PSP_RING_FRAME)
+				len = PSP_RING_FRAME;
+			memcpy(buf, slot->frame, len);
+			status = -1;
+			handle = -1;
+			if(psp_parse_frame(buf, len, &frame) > 0 && frame.type == PSP_SUBMIT && read_submit(c, c->uid, &frame, &job) > 0)
+			{
+				handle = job->job_number;
+				status = submit_job(job);
+			}
+			slot->status = status;
+			slot->handle = status == 0 ? handle : (uint32_t)-1;
+			__atomic_store_n(&slot->state, PSP_SLOT_DONE, __ATOMIC_SEQ_CST);
+			if(__atomic_load_n(&slot->waiting, __ATOMIC_SEQ_CST))
+				syscall(SYS_futex, &slot->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+		}
+	}
+}
+
+/**
+ * Open, creating it if need be, the message queue named by MQUEUE.  The
+ * kernel keeps whatever is sent while the server is down, so the queue is
+ * left behind when the server exits.  Anyone who can send to the queue
+ * prints as the server's user, so a queue anyone else can reach is refused.
+ * @return 0 on success, -1 on error
+ */
+static int open_mqueue()
+{
+	struct mq_attr attr = { .mq_maxmsg = PSP_MQ_DEPTH, .mq_msgsize = PSP_MQ_MSGSIZE };
+	struct stat st;
+	int flags = O_RDONLY | O_CREAT | O_NONBLOCK | O_CLOEXEC;
+
+	mqueue.q = mq_open(mqueue.name, flags, S_IRUSR | S_IWUSR, &attr);
+	// an unprivileged user may not be allowed that deep a queue
+	if(mqueue.q == (mqd_t)-1 && errno == EINVAL)
+		mqueue.q = mq_open(mqueue.name, flags, S_IRUSR | S_IWUSR, NULL);
+	if(mqueue.q == (mqd_t)-1)
+	{
+		perror("mq_open");
+		return -1;
+	}
+	if(fstat(mqueue.q, &st) || st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO)) ||
+		mq_getattr(mqueue.q, &attr))
+	{
+		eprintf("Message queue %s is open to other users\n", mqueue.name);
+		mq_close(mqueue.q);
+		mqueue.q = (mqd_t)-1;
+		return -1;
+	}
+	mqueue.msgsize = attr.mq_msgsize;
+	mqueue.buf = malloc(mqueue.msgsize);
+	return 0;
+}
+
+/**
+ * Take every job waiting on the message queue, highest priority first as
+ * the kernel hands them out.  A message's priority becomes its job's.
+ */
+static void service_mqueue()
+{
+	struct psp_frame frame;
+	struct print_job * job;
+	unsigned int priority;
+	ssize_t len;
+	int rv;
+
+	while((len = mq_receive(mqueue.q, mqueue.buf, mqueue.msgsize, &priority)) >= 0)
+	{
+		if(psp_parse_frame(mqueue.buf, len, &frame) <= 0 || frame.type != PSP_SUBMIT ||
+			(rv = read_submit(NULL, geteuid(), &frame, &job)) < 0)
+		{
+			eprintf("Malformed message on %s\n", mqueue.name);
+			continue;
+		}
+		// the sender is not waiting for an answer, the job is only dropped
+		if(rv == 0)
+			continue;
+		job->priority = priority;
+		submit_job(job);
+	}
+	if(errno != EAGAIN)
+		perror("mq_receive");
+}
+
+/**
+ * Send a RESULT frame with a status and, unless it is negative, a job
+ * handle.
+ */
+static void send_result(struct connection * c, int32_t status, long long handle)
+{
+	send_result_fd(c, status, handle, -1);
+}
+
+/**
+ * Send a RESULT frame, passing a file descriptor along with it unless
+ * pass_fd is -1.
+ */
+static void send_result_fd(struct connection * c, int32_t status, long long handle, int pass_fd)
+{
+	char buf[PSP_HEADER_SIZE + 2 * (PSP_FIELD_HEADER_SIZE + 4)];
+	char value[4];
+	char * p = buf + PSP_HEADER_SIZE;
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr * cmsg;
+
+	psp_put_u32(value, status);
+	p = psp_put_field(p, PSP_STATUS, value, 4);
+	if(handle >= 0)
+	{
+		psp_put_u32(value, handle);
+		p = psp_put_field(p, PSP_HANDLE, value, 4);
+	}
+	psp_put_header(buf, PSP_RESULT, p - buf - PSP_HEADER_SIZE);
+	if(pass_fd == -1)
+	{
+		if(write(c->fd, buf, p - buf) != p - buf)
+			perror("write error");
+		return;
+	}
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = p - buf;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+	if(sendmsg(c->fd, &msg, 0) != p - buf)
+		perror("sendmsg error");
+}
+
+/**
+ * Answer a STATS request.  Rates are worked out over the time since the
+ * previous request, or since startup for the first one.
+ */
+static void send_stats(struct connection * c)
+{
+	struct printer_group * g;
+	struct printer * p;
+	uint64_t now = stats_now_ns();
+	uint64_t enqueued, dequeued;
+	double interval = (now - last_stats_ns) / 1e9;
+	double uptime = (now - start_ns) / 1e9;
+	char * text = NULL;
+	size_t len = 0;
+	FILE * out;
+
+	out = open_memstream(&text, &len);
+	if(out == NULL)
+		return;
+	fprintf(out, "uptime_s %.3f\ninterval_s %.3f\n", uptime, interval);
+	for(g = printer_group_head; g; g = g->next_group)
+	{
+		// dequeued is read first so the depth never goes negative
+		dequeued = atomic_load_explicit(&g->stats.dequeued, memory_order_relaxed);
+		enqueued = atomic_load_explicit(&g->stats.enqueued, memory_order_relaxed);
+		fprintf(out, "group %s depth=%llu enqueued=%llu dequeued=%llu rejected=%llu requeued=%llu cancelled=%llu paused=%llu enqueue_rate=%.2f dequeue_rate=%.2f\n",
+			g->name, (unsigned long long)(enqueued - dequeued - g->stats.cancelled - g->stats.paused),
+			(unsigned long long)enqueued, (unsigned long long)dequeued,
+			(unsigned long long)atomic_load_explicit(&g->stats.rejected, memory_order_relaxed),
+			(unsigned long long)atomic_load_explicit(&g->stats.requeued, memory_order_relaxed),
+			(unsigned long long)g->stats.cancelled, (unsigned long long)g->stats.paused,
+			interval > 0 ? (enqueued - g->stats.last_enqueued) / interval : 0,
+			interval > 0 ? (dequeued - g->stats.last_dequeued) / interval : 0);
+		g->stats.last_enqueued = enqueued;
+		g->stats.last_dequeued = dequeued;
+		for(p = g->printer_queue; p; p = p->next)
+		{
+			uint64_t busy = atomic_load_explicit(&p->stats.busy_ns, memory_order_relaxed);
+			fprintf(out, "printer %s group=%s jobs=%llu bytes=%llu cache_hits=%llu failed=%llu tripped=%d outstanding=%lld rate_Bps=%llu busy_s=%.3f utilisation=%.3f\n",
+				p->driver.name, g->name,
+				(unsigned long long)atomic_load_explicit(&p->stats.jobs, memory_order_relaxed),
+				(unsigned long long)atomic_load_explicit(&p->stats.bytes, memory_order_relaxed),
+				(unsigned long long)atomic_load_explicit(&p->stats.cache_hits, memory_order_relaxed),
+				(unsigned long long)atomic_load_explicit(&p->stats.failed, memory_order_relaxed),
+				atomic_load_explicit(&p->stats.tripped, memory_order_relaxed),
+				(long long)atomic_load_explicit(&p->outstanding, memory_order_relaxed),
+				(unsigned long long)atomic_load_explicit(&p->rate, memory_order_relaxed),
+				busy / 1e9, uptime > 0 ? busy / 1e9 / uptime : 0);
+		}
+		histogram_print(out, "wait", g->name, &g->stats.wait);
+		histogram_print(out, "print", g->name, &g->stats.print);
+	}
+	fclose(out);
+	last_stats_ns = now;
+
+	send_reply(c, PSP_STATS_REPLY, PSP_TEXT, text, len);
+	free(text);
+}
+
+/**
+ * Release a client connection and anything it left half finished.
+ */
+static void close_connection(struct connection * c)
+{
+	struct job_entry * e;
+	struct connection ** w;
+
+	// stop waiting on a job, the client is gone
+	if(c->wait_for != -1 && (e = job_index_find(&job_index, c->wait_for)))
+	{
+		for(w = &e->waiters; *w != c; w = &(*w)->next_waiter);
+		*w = c->next_waiter;
+	}
+	// an install it asked for goes on without it
+	if(c->installing)
+		c->installing->client = NULL;
+	// a client's ring goes with its connection
+	if(c->ring)
+	{
+		for(w = &rings.head; *w != c; w = &(*w)->next_ring);
+		*w = c->next_ring;
+		munmap(c->ring, c->ring_size);
+	}
+	// closing the socket also removes it from the epoll set
+	close(c->fd);
+	while(c->num_fds)
+		close(c->fds[--c->num_fds]);
+	if(c->job)
+		discard_job(c->job);
+	free(c->buf);
+	free(c);
+}
+
+/**
+ * Free a job that will never be printed.
+ */
+static void discard_job(struct print_job * job)
+{
+	if(job->fd != -1)
+		close(job->fd);
+	job_pool_free(job);
+}
+
+/**
+ * Hand a fully described job to the queue of its printer group.  A job that
+ * cannot be printed is discarded.
+ * @return 0 if the job was queued, or -1 if it was not
+ */
+static int submit_job(struct print_job * job)
+{
+	struct printer_group * g;
+	struct stat st;
+	long long number = job->job_number;
+
+	if(job->group < 0)
+	{
+		eprintf("Trying to print without setting printer\n");
+		job_log_printf("job %lld rejected: no printer group", job->job_number);
+		discard_job(job);
+		return -1;
+	}
+	if(!job->file_name)
+	{
+		eprintf("Trying to print without providing input file\n");	
+		job_log_printf("job %lld rejected: no input file", job->job_number);
+		discard_job(job);
+		return -1;
+	}
+	// the size is what the shortest job first scheduler goes by
+	if((job->fd != -1 ? fstat(job->fd, &st) : stat(job->file_name, &st)) == 0)
+		job->size = st.st_size;
+	g = printer_groups[job->group];
+	printf("Printing job in %s\n", g->name);
+	// logged before the push so the line comes ahead of the printer's
+	job_log_printf("job %lld queued in %s: name=%s file=%s size=%lld owner=%u description=%s",
+		job->job_number, g->name, job->job_name ? job->job_name : "",
+		job->file_name, job->size, (unsigned)job->owner,
+		job->description ? job->description : "");
+	// journaled and counted first, a printer may finish the job as soon as
+	// it is pushed
+	journal_submitted(job, g->name);
+	job->enqueue_ns = stats_now_ns();
+	atomic_fetch_add_explicit(&g->stats.enqueued, 1, memory_order_relaxed);
+	if(queue_job(g, job, 0))
+	{
+		eprintf("Job queue for %s is full, dropping job\n", g->name);
+		atomic_fetch_sub_explicit(&g->stats.enqueued, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&g->stats.rejected, 1, memory_order_relaxed);
+		journal_finished(job->job_number);
+		job_log_printf("job %lld rejected: %s is full", job->job_number, g->name);
+		discard_job(job);
+		return -1;
+	}
+	// a printer may already have finished with the job, but its completion
+	// is only seen by this thread later on; the entry's job number guards
+	// against the job having been recycled
+	index_job(number, job);
+	return 0;
+}
+
+/**
+ * Add a queued job to the job index.  The job number is passed apart from the
+ * job because a printer may already have recycled the job.
+ */
+static void index_job(long long job_number, struct print_job * job)
+{
+	// the job is printed all the same, it just cannot be found by its handle
+	if(job_index_insert(&job_index, job_number, job))
+		eprintf("Out of memory, job %lld cannot be cancelled or waited on\n", job_number);
+}
+
+/**
+ * Take a finished job out of the job index, remembering how it ended for a
+ * WAIT that comes later.
+ * @param status 0 if the job printed, or -1 if it did not
+ */
+static void unindex_job(struct job_entry * e, int status)
+{
+	retired_jobs[e->job_number & (RETIRED_JOBS - 1)].job_number = e->job_number;
+	retired_jobs[e->job_number & (RETIRED_JOBS - 1)].status = status;
+	job_index_remove(&job_index, e);
+}
+
+/**
+ * Answer a WAIT request once the job has finished.  A job that has already
+ * finished is answered straight away with how it ended, if that is still
+ * remembered; otherwise, as for a job that was never queued, the answer is
+ * negative.
+ */
+static void wait_for_job(struct connection * c, long long handle)
+{
+	struct job_entry * e = job_index_find(&job_index, handle);
+
+	if(e == NULL)
+	{
+		if(retired_jobs[handle & (RETIRED_JOBS - 1)].job_number == handle)
+			send_result(c, retired_jobs[handle & (RETIRED_JOBS - 1)].status, handle);
+		else
+			send_result(c, -1, handle);
+		return;
+	}
+	if(c->wait_for != -1)
+	{
+		// one wait at a time per connection
+		send_result(c, -1, handle);
+		return;
+	}
+	c->wait_for = handle;
+	c->next_waiter = e->waiters;
+	e->waiters = c;
+}
+
+/**
+ * Whether a user is the server's user or root, and so may act on anyone's
+ * jobs and on the server itself
+ */
+static int trusted_uid(uid_t uid)
+{
+	return uid == geteuid() || uid == 0;
+}
+
+/**
+ * Whether a client runs as a trusted user
+ */
+static int trusted_client(const struct connection * c)
+{
+	return trusted_uid(c->uid);
+}
+
+/**
+ * Cancel, pause or resume a job that no printer has taken yet, on behalf of
+ * the job's owner or a trusted client.  A cancelled job counts as failed to
+ * anyone waiting on it.
+ * @return 0 on success, 1 if a printer already has the job or it has
+ *         finished, or -1 if the client may not touch the job or it could
+ *         not be queued again
+ */
+static int control_job(struct connection * client, int type, long long handle)
+{
+	struct job_entry * e = job_index_find(&job_index, handle);
+	struct printer_group * g;
+	struct print_job_list * list;
+	struct printer * p;
+	struct print_job * job;
+	struct connection * c;
+	int state, rv;
+
+	// a printer may be done with the job and have recycled it already, only
+	// this thread hands out job numbers so a match means it is still ours
+	if(e == NULL || e->job->job_number != handle)
+		return 1;
+	job = e->job;
+	if(job->owner != client->uid && !trusted_client(client))
+	{
+		job_log_printf("job %lld: control refused to uid %u", handle, (unsigned)client->uid);
+		return -1;
+	}
+	g = printer_groups[job->group];
+	state = atomic_load(&job->state);
+	// a job a printer has taken, or has handed back to be queued again, is
+	// out of reach; the printer it was on may even be gone
+	if(state == PRINT_JOB_TAKEN)
+		return 1;
+	// a queued job is on the list it was last put on, a paused one on none
+	list = state == PRINT_JOB_QUEUED ? job->assigned : &g->job_queue;
+	p = state == PRINT_JOB_QUEUED ? list_owner(g, list) : NULL;
+	switch(type)
+	{
+		case PSP_CANCEL:
+			rv = print_job_list_cancel(list, job);
+			if(rv < 0)
+				return 1;
+			if(p)
+				atomic_fetch_sub_explicit(&p->outstanding, job->size, memory_order_relaxed);
+			g->stats.cancelled++;
+			if(state == PRINT_JOB_PAUSED || state == PRINT_JOB_EVICTED)
+				g->stats.paused--;
+			journal_finished(handle);
+			job_log_printf("job %lld cancelled", handle);
+			while((c = e->waiters))
+			{
+				e->waiters = c->next_waiter;
+				c->wait_for = -1;
+				send_result(c, -1, handle);
+			}
+			unindex_job(e, -1);
+			// a job left in a ring is freed by the printer that skips it
+			if(rv == 0)
+				discard_job(job);
+			return 0;
+		case PSP_PAUSE:
+			if(print_job_list_pause(list, job))
+				return 1;
+			if(p)
+				atomic_fetch_sub_explicit(&p->outstanding, job->size, memory_order_relaxed);
+			if(state != PRINT_JOB_PAUSED && state != PRINT_JOB_EVICTED)
+			{
+				g->stats.paused++;
+				job_log_printf("job %lld paused", handle);
+			}
+			return 0;
+		case PSP_RESUME:
+			if(state != PRINT_JOB_PAUSED && state != PRINT_JOB_EVICTED)
+				return state == PRINT_JOB_QUEUED ? 0 : 1;
+			// the time spent paused is not counted as waiting
+			job->enqueue_ns = stats_now_ns();
+			if(queue_job(g, job, 1))
+				return -1;
+			g->stats.paused--;
+			job_log_printf("job %lld resumed", handle);
+			return 0;
+	}
+	return -1;
+}
+
+/**
+ * Called by a printer thread when it is done with a job.  The main thread is
+ * only woken for the first of a batch of completions.
+ */
+static void complete_job(long long job_number, int status)
+{
+	struct completion * items;
+	uint64_t one = 1;
+	int wake;
+
+	pthread_mutex_lock(&completions.lock);
+	if(completions.len == completions.size)
+	{
+		items = realloc(completions.items, (completions.size ? 2 * completions.size : 64) * sizeof(struct completion));
+		if(items == NULL)
+		{
+			pthread_mutex_unlock(&completions.lock);
+			perror("realloc");
+			return;
+		}
+		completions.items = items;
+		completions.size = completions.size ? 2 * completions.size : 64;
+	}
+	completions.items[completions.len].job_number = job_number;
+	completions.items[completions.len].status = status;
+	wake = completions.len++ == 0;
+	pthread_mutex_unlock(&completions.lock);
+
+	if(wake && write(completions.fd, &one, sizeof(one)) != sizeof(one))
+		perror("eventfd write");
+}
+
+/**
+ * Retire the jobs the printers have finished with and answer everyone
+ * waiting on them.  The batch is swapped out under the lock so printers are
+ * never held up while clients are answered.
+ */
+static void finish_jobs()
+{
+	static struct completion * batch;
+	static size_t batch_size;
+	struct completion * items;
+	struct connection * c;
+	struct job_entry * e;
+	uint64_t count;
+	size_t len, i, size;
+
+	if(read(completions.fd, &count, sizeof(count)) != sizeof(count))
+		return;
+	pthread_mutex_lock(&completions.lock);
+	items = completions.items;
+	len = completions.len;
+	size = completions.size;
+	completions.items = batch;
+	completions.size = batch_size;
+	completions.len = 0;
+	pthread_mutex_unlock(&completions.lock);
+
+	for(i = 0; i < len; i++)
+	{
+		e = job_index_find(&job_index, items[i].job_number);
+		if(e == NULL)
+			continue;
+		if(items[i].status == JOB_REDISPATCH || items[i].status == JOB_REQUEUE)
+		{
+			redispatch_job(e->job, items[i].status == JOB_REQUEUE);
+			continue;
+		}
+		while((c = e->waiters))
+		{
+			e->waiters = c->next_waiter;
+			c->wait_for = -1;
+			send_result(c, items[i].status ? -1 : 0, items[i].job_number);
+		}
+		unindex_job(e, items[i].status ? -1 : 0);
+	}
+	batch = items;
+	batch_size = size;
+}
+
+/**
+ * Queue a job of a least bytes group again, one that a printer handed back
+ * or one left on a list no printer takes from.  A job that cannot be queued
+ * fails.
+ * @param requeued  1 if requeue_job() counted the job as queued again
+ */
+static void redispatch_job(struct print_job * job, int requeued)
+{
+	struct printer_group * g = printer_groups[job->group];
+	struct connection * c;
+	struct job_entry * e;
+
+	if(queue_job(g, job, 0) == 0)
+		return;
+	eprintf("Job queue for %s is full, dropping job\n", g->name);
+	if(requeued)
+	{
+		atomic_fetch_sub_explicit(&g->stats.enqueued, 1, memory_order_relaxed);
+		atomic_fetch_sub_explicit(&g->stats.requeued, 1, memory_order_relaxed);
+	}
+	else
+	{
+		// the job was only counted when it was first queued, and now
+		// leaves the queue without a printer taking it
+		atomic_fetch_add_explicit(&g->stats.dequeued, 1, memory_order_relaxed);
+	}
+	atomic_fetch_add_explicit(&g->stats.rejected, 1, memory_order_relaxed);
+	journal_finished(job->job_number);
+	job_log_printf("job %lld rejected: %s is full", job->job_number, g->name);
+	if((e = job_index_find(&job_index, job->job_number)))
+	{
+		while((c = e->waiters))
+		{
+			e->waiters = c->next_waiter;
+			c->wait_for = -1;
+			send_result(c, -1, job->job_number);
+		}
+		unindex_job(e, -1);
+	}
+	discard_job(job);
+}
+
+/**
+ * Queue a job recovered from the journal.  Its file is opened again by path
+ * when it prints, with the server's permissions, so as with a ring job only
+ * a trusted user's job is taken; anyone else's path may name a file they
+ * could never have handed over themselves.
+ * @return 0 if the job was queued, or -1 if it was dropped
+ */
+static int recover_job(struct print_job * job, const char * group, size_t group_len, void * arg)
+{
+	if(!trusted_uid(job->owner))
+	{
+		eprintf("Dropping recovered job %lld, its file cannot be opened again for user %u\n",
+			job->job_number, (unsigned)job->owner);
+		job_log_printf("job %lld dropped on recovery: owner %u is not trusted", job->job_number, (unsigned)job->owner);
+		job_pool_free(job);
+		return -1;
+	}
+	job->group = find_group(group, group_len);
+	if(job->group < 0)
+	{
+		eprintf("Dropping recovered job %lld, no printer group %.*s\n", job->job_number, (int)group_len, group);
+		job_pool_free(job);
+		return -1;
+	}
+	job->accept_ns = job->enqueue_ns = stats_now_ns();
+	atomic_fetch_add_explicit(&printer_groups[job->group]->stats.enqueued, 1, memory_order_relaxed);
+	if(queue_job(printer_groups[job->group], job, 0))
+	{
+		atomic_fetch_sub_explicit(&printer_groups[job->group]->stats.enqueued, 1, memory_order_relaxed);
+		eprintf("Dropping recovered job %lld, %s is full\n", job->job_number, printer_groups[job->group]->name);
+		job_pool_free(job);
+		return -1;
+	}
+	job_log_printf("job %lld recovered into %s", job->job_number, printer_groups[job->group]->name);
+	index_job(job->job_number, job);
+	return 0;
+}
+
+/**
+ * Handle one line of a request sent by a client.  Each connection carries its
+ * own partially built job so clients can interleave their requests freely.
+ */
+static void parse_line(struct connection * c, char * line)
+{
+
+	if(strncmp(line, "LIST_DRIVERS", 12) == 0)
+	{
+		// the listing goes out with its terminator
+		if(write(c->fd, driver_list->text, driver_list->length + 1) != driver_list->length + 1){
+			perror("write error");
+		}
+	}
+	else if(strncmp(line, "NEW", 3) == 0)
+	{
+		if(c->job)
+			discard_job(c->job);
+		c->job = job_pool_alloc();
+		// a text client gets no answer; without a job the lines up to its
+		// PRINT are ignored
+		if(c->job == NULL)
+		{
+			eprintf("Out of memory for a new job\n");
+			return;
+		}
+		c->job->accept_ns = stats_now_ns();
+		c->job->job_number = job_number++;
+		c->job->owner = c->uid;
+	}
+	else if(c->job && strncmp(line, "FILE", 4) == 0)
+	{
+		strsep(&line, " ");
+		job_pool_set_string(c->job, &c->job->file_name, line, strlen(line));
+	}
+	else if(c->job && strncmp(line, "NAME", 4) == 0)
+	{
+		strsep(&line, " ");
+		job_pool_set_string(c->job, &c->job->job_name, line, strlen(line));
+	}
+	else if(c->job && strncmp(line, "DESCRIPTION", 11) == 0)
+	{
+		strsep(&line, " ");
+		job_pool_set_string(c->job, &c->job->description, line, strlen(line));
+	}
+	else if(c->job && strncmp(line, "PRINTER", 7) == 0)
+	{
+		strsep(&line, " ");
+		c->job->group = find_group(line, strlen(line));
+		if(c->job->group < 0)
+		{
+			eprintf("Invalid printer group name given: %s\n", line);
+			return;
+		}
+	}
+	else if(c->job && strncmp(line, "PRIORITY", 8) == 0)
+	{
+		strsep(&line, " ");
+		c->job->priority = atoi(line);
+	}
+	else if(c->job && strncmp(line, "PRINT", 5) == 0)
+	{
+		submit_job(c->job);
+		c->job = NULL;
+	}
+	else if(strncmp(line, "EXIT", 4) == 0)
+	{
+		if(trusted_client(c))
+			exit_flag = 1;
+		else
+		{
+			eprintf("Refusing EXIT from uid %u\n", (unsigned)c->uid);
+		}
+	}
+}
+
+/**
+ * Build a new driver listing after the printers have changed.  It is sized
+ * to fit every printer, and replaces the last one under the next epoch.
+ * @return 0 on success, or -1 if there was no memory for it, in which case
+ *         the last listing and its epoch are kept
+ */
+static int list_printer_drivers(){
+	struct driver_list * list;
+	struct printer_group * g;
+	struct printer * p;
+	size_t length = 0, name_len, group_len;
+	uint32_t count = 0;
+	char * text;
+
+	for(g = printer_group_head; g; g=g->next_group){
+		for(p = g->printer_queue; p; p = p->next){
+			length += strlen(p->driver.name) + strlen(g->name) + 2;
+			count++;
+		}
+	}
+	list = malloc(sizeof(struct driver_list) + length + 1);
+	if(list == NULL)
+	{
+		perror("malloc");
+		return -1;
+	}
+	text = list->text;
+	for(g = printer_group_head; g; g=g->next_group){
+		group_len = strlen(g->name);
+		for(p = g->printer_queue; p; p = p->next){
+			name_len = strlen(p->driver.name);
+			memcpy(text, p->driver.name, name_len);
+			text[name_len] = '|';
+			memcpy(text + name_len + 1, g->name, group_len);
+			text[name_len + 1 + group_len] = '\n';
+			text += name_len + group_len + 2;
+		}
+	}
+	*text = '\0';
+	list->epoch = driver_list ? driver_list->epoch + 1 : 1;
+	list->count = count;
+	list->length = length;
+	free(driver_list);
+	driver_list = list;
+	return 0;
+}
+
+/**
+ * Send the driver listing, leaving out the text if the client already has
+ * the listing of this epoch.
+ */
+static void send_driver_list(struct connection * c, uint32_t epoch)
+{
+	char head[PSP_HEADER_SIZE + 3 * PSP_FIELD_HEADER_SIZE + 8];
+	char value[4];
+	struct iovec iov[2];
+	uint32_t length = driver_list->epoch == epoch ? 0 : driver_list->length;
+	char * p = head + PSP_HEADER_SIZE;
+
+	psp_put_u32(value, driver_list->epoch);
+	p = psp_put_field(p, PSP_EPOCH, value, 4);
+	psp_put_u32(value, driver_list->count);
+	p = psp_put_field(p, PSP_COUNT, value, 4);
+	if(driver_list->epoch != epoch)
+	{
+		p = psp_put_u16(p, PSP_TEXT);
+		p = psp_put_u16(p, 0);
+		p = psp_put_u32(p, length);
+	}
+	psp_put_header(head, PSP_DRIVER_LIST, p - head - PSP_HEADER_SIZE + length);
+	iov[0].iov_base = head;
+	iov[0].iov_len = p - head;
+	iov[1].iov_base = driver_list->text;
+	iov[1].iov_len = length;
+	if(writev(c->fd, iov, 2) != (ssize_t)(p - head + length))
+		perror("write error");
+}
+
+/**
+ * Install the driver of one PRINTER line
+ */
+static void * install_thread(void * arg)
+{
+	struct pending_printer * pending = arg;
+
+	pending->rv = printer_install(&pending->printer->driver, pending->location);
+	return NULL;
+}
+
+/**
+ * Install the drivers of every PRINTER line at once, each on a thread of its
+ * own, so startup takes as long as the slowest driver rather than all of
+ * them together, and a driver that never turns up only costs its install
+ * timeout.  The printers that answer join their groups in the order they
+ * were listed in.
+ */
+static void install_printers(struct pending_printer * pending, size_t count)
+{
+	struct printer * p;
+	size_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		pending[i].started = pthread_create(&pending[i].tid, NULL, install_thread, &pending[i]) == 0;
+		if(!pending[i].started)
+			install_thread(&pending[i]);
+	}
+	for(i = 0; i < count; i++)
+	{
+		if(pending[i].started)
+			pthread_join(pending[i].tid, NULL);
+		if(pending[i].rv)
+		{
+			eprintf("Leaving out printer %s\n", pending[i].location);
+			free(pending[i].printer);
+		}
+		else
+		{
+			pending[i].printer->job_queue = &pending[i].group->job_queue;
+			if(pending[i].group->printer_queue)
+			{
+				for(p = pending[i].group->printer_queue; p->next; p = p->next);
+				p->next = pending[i].printer;
+			}
+			else
+				pending[i].group->printer_queue = pending[i].printer;
+		}
+		free(pending[i].location);
+	}
+}
+
+static void parse_rc_file(FILE* fp)
+{
+	char * line = NULL;
+	char * ptr;
+	size_t n = 0;
+	struct printer_group * group = NULL;
+	struct printer_group * g;
+	struct printer * printer = NULL;
+	struct printer * p;
+	struct pending_printer * pending = NULL;
+	size_t num_pending = 0;
+
+	// get each line of text from the config file
+	while(getline(&line, &n, fp) > 0)
+	{
+		// if the line is a comment
+		if(line[0] == '#')
+				continue;
+
+		// If the line is configuring the job log
+		if(strncmp(line, "LOG_", 4) == 0)
+		{
+			ptr = strtok(line, " ");
+			char * value = strtok(NULL, " \n");
+			if(value == NULL)
+			{
+				eprintf("Missing value for %s\n", ptr);
+			}
+			else if(strcmp(ptr, "LOG_FILE") == 0)
+				log_config.path = strdup(value);
+			else if(strcmp(ptr, "LOG_FLUSH_MS") == 0)
+				log_config.flush_ms = atoi(value);
+			else if(strcmp(ptr, "LOG_ROTATE_BYTES") == 0)
+				log_config.rotate_bytes = strtoul(value, NULL, 10);
+			else if(strcmp(ptr, "LOG_KEEP") == 0)
+				log_config.keep = atoi(value);
+			else if(strcmp(ptr, "LOG_LINES") == 0)
+				log_config.lines = strtoul(value, NULL, 10);
+			else
+			{
+				eprintf("Unknown setting %s\n", ptr);
+			}
+		}
+		// If the line is configuring the job journal
+		else if(strncmp(line, "JOURNAL", 7) == 0)
+		{
+			ptr = strtok(line, " ");
+			char * value = strtok(NULL, " \n");
+			if(value == NULL)
+			{
+				eprintf("Missing value for %s\n", ptr);
+			}
+			else if(strcmp(ptr, "JOURNAL") == 0)
+				journal_path = strdup(value);
+			else if(strcmp(ptr, "JOURNAL_COMPACT_BYTES") == 0)
+				journal_compact_bytes = strtoul(value, NULL, 10);
+			else
+			{
+				eprintf("Unknown setting %s\n", ptr);
+			}
+		}
+		// If the line is configuring the output cache
+		else if(strncmp(line, "CACHE_", 6) == 0)
+		{
+			ptr = strtok(line, " ");
+			char * value = strtok(NULL, " \n");
+			if(value == NULL)
+			{
+				eprintf("Missing value for %s\n", ptr);
+			}
+			else if(strcmp(ptr, "CACHE_DIR") == 0)
+				cache_config.path = strdup(value);
+			else if(strcmp(ptr, "CACHE_BYTES") == 0)
+				cache_config.max_bytes = strtoul(value, NULL, 10);
+			else if(strcmp(ptr, "CACHE_ENTRIES") == 0)
+				cache_config.max_entries = strtoul(value, NULL, 10);
+			else
+			{
+				eprintf("Unknown setting %s\n", ptr);
+			}
+		}
+		// If the line is saying where the next printers' drivers write to
+		else if(strncmp(line, "OUTPUT_DIR", 10) == 0)
+		{
+			strtok(line, " ");
+			ptr = strtok(NULL, "\n");
+			output_dir = ptr ? strdup(ptr) : NULL;
+		}
+		// If the line is naming a message queue to take jobs from
+		else if(strncmp(line, "MQUEUE", 6) == 0)
+		{
+			strtok(line, " ");
+			ptr = strtok(NULL, " \n");
+			mqueue.name = strdup(ptr ? ptr : PSP_MQ_NAME);
+		}
+		// If the line is configuring how printers deal with their drivers
+		else if(strncmp(line, "DRIVER_", 7) == 0)
+		{
+			ptr = strtok(line, " ");
+			char * value = strtok(NULL, " \n");
+			if(value == NULL)
+			{
+				eprintf("Missing value for %s\n", ptr);
+			}
+			else if(strcmp(ptr, "DRIVER_WRITE_TIMEOUT_MS") == 0)
+				driver_write_timeout_ms = atoi(value);
+			else if(strcmp(ptr, "DRIVER_ACK_TIMEOUT_MS") == 0)
+				driver_ack_timeout_ms = atoi(value);
+			else if(strcmp(ptr, "DRIVER_INSTALL_TIMEOUT_MS") == 0)
+				driver_install_timeout_ms = atoi(value);
+			else if(strcmp(ptr, "DRIVER_FAILURES") == 0)
+				driver_failures = atoi(value);
+			else if(strcmp(ptr, "DRIVER_COOLDOWN_MS") == 0)
+				driver_cooldown_ms = atoi(value);
+			else if(strcmp(ptr, "DRIVER_RETRIES") == 0)
+				driver_retries = atoi(value);
+			else
+			{
+				eprintf("Unknown setting %s\n", ptr);
+			}
+		}
+		// If the line is defining a new printer group
+		else if(strncmp(line, "PRINTER_GROUP", 13) == 0)
+		{
+			strtok(line, " ");
+			ptr = strtok(NULL, "\n");
+			group = calloc(1, sizeof(struct printer_group));
+			group->name = malloc(strlen(ptr)+1);
+			strcpy(group->name, ptr);
+
+			if(printer_group_head)
+				printer_groups[num_printer_groups - 1]->next_group = group;
+			else
+				printer_group_head = group;
+			group->index = num_printer_groups++;
+			printer_groups = realloc(printer_groups, num_printer_groups * sizeof(struct printer_group *));
+			printer_groups[group->index] = group;
+		}
+		// If the line is choosing the scheduling policy of the group
+		else if(group && strncmp(line, "SCHEDULER", 9) == 0)
+		{
+			strtok(line, " ");
+			ptr = strtok(NULL, " \n");
+			group->job_queue.ops = ptr ? print_job_list_find_ops(ptr) : NULL;
+			if(group->job_queue.ops == NULL)
+			{
+				eprintf("Unknown scheduler for group %s\n", group->name);
+				exit(1);
+			}
+			ptr = strtok(NULL, " \n");
+			if(ptr)
+				group->job_queue.capacity = strtoul(ptr, NULL, 10);
+		}
+		// If the line is choosing how the group hands jobs to its printers
+		else if(group && strncmp(line, "DISPATCH", 8) == 0)
+		{
+			strtok(line, " ");
+			ptr = strtok(NULL, " \n");
+			if(ptr && strcmp(ptr, "shared") == 0)
+				group->least_bytes = 0;
+			else if(ptr && strcmp(ptr, "least_bytes") == 0)
+				group->least_bytes = 1;
+			else
+			{
+				eprintf("Unknown dispatch for group %s\n", group->name);
+				exit(1);
+			}
+		}
+		// If the line is defining a new printer
+		else if(strncmp(line, "PRINTER", 7) == 0)
+		{
+			strtok(line, " ");
+			ptr = strtok(NULL, "\n");
+			printer = calloc(1, sizeof(struct printer));
+			printer->driver.write_timeout_ms = driver_write_timeout_ms;
+			printer->driver.ack_timeout_ms = driver_ack_timeout_ms;
+			printer->driver.install_timeout_ms = driver_install_timeout_ms;
+			printer->output_dir = output_dir;
+			// installed along with the others once the whole file is read
+			pending = realloc(pending, (num_pending + 1) * sizeof(struct pending_printer));
+			pending[num_pending].printer = printer;
+			pending[num_pending].group = group;
+			pending[num_pending].location = strdup(ptr);
+			num_pending++;
+		}
+	}
+
+	install_printers(pending, num_pending);
+	free(pending);
+	build_group_table();
+
+	// print out the printer groups
+	dprintf("\n--- Printers ---\n"); 
+	for(g = printer_group_head; g; g = g->next_group)
+	{
+		dprintf("Printer Group %s\n", g->name);
+		for(p = g->printer_queue; p; p = p->next)
+		{
+			dprintf("\tPrinter %s\n", p->driver.name);
+		}
+	}
+	dprintf("----------------\n\n");
+
+}
+
+/**
+ * Hash a group name (FNV-1a)
+ */
+static unsigned hash_group_name(const char * name, size_t len)
+{
+	unsigned h = 2166136261u;
+	while(len--)
+	{
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Intern every printer group into group_table so jobs can be routed without
+ * walking the list of groups.  The table is kept at most half full.
+ */
+static void build_group_table()
+{
+	unsigned size = 2;
+	unsigned h;
+	size_t len;
+	int i;
+
+	while(size < 2 * (unsigned)num_printer_groups)
+		size <<= 1;
+	group_table = calloc(size, sizeof(struct printer_group *));
+	group_table_mask = size - 1;
+
+	for(i = 0; i < num_printer_groups; i++)
+	{
+		len = strlen(printer_groups[i]->name);
+		if(find_group(printer_groups[i]->name, len) >= 0)
+		{
+			eprintf("Printer group %s is defined twice\n", printer_groups[i]->name);
+			exit(1);
+		}
+		for(h = hash_group_name(printer_groups[i]->name, len); group_table[h & group_table_mask]; h++);
+		group_table[h & group_table_mask] = printer_groups[i];
+	}
+}
+
+/**
+ * Look up a printer group by name.  The name need not be NUL terminated.
+ * @return the index of the group, or -1 if there is no such group
+ */
+static int find_group(const char * name, size_t len)
+{
+	unsigned h;
+	struct printer_group * g;
+
+	for(h = hash_group_name(name, len); (g = group_table[h & group_table_mask]); h++)
+	{
+		if(strncmp(g->name, name, len) == 0 && g->name[len] == '\0')
+			return g->index;
+	}
+	return -1;
+}
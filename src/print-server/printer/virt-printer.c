@@ -216,6 +216,7 @@ int main(int argc, char* argv[])
 				perror("execvp");
 				close(pipefd[0]);
 				close(pipefd[1]);
+				exit(1);
 			// if parent
 			}else{
 				// close the read end
@@ -239,8 +240,13 @@ int main(int argc, char* argv[])
 				if(verbose_flag) printf("reached the ##END##\n"); fflush(stdout);
 				fclose(write_end);
 				write_end = 0;
-				// wait for child to exit
+				// wait for child to exit, then tell the server how the job went
 				wait(&status);
+				if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+					fprintf(print_stream_out, "##DONE##\n");
+				else
+					fprintf(print_stream_out, "##FAILED##\n");
+				fflush(print_stream_out);
 				
 				//fclose(write_end);
 			}
@@ -1,57 +1,335 @@
-
+/**
+ * @file      printer_driver.c
+ * @author    Jeramie Vens
+ * @date      2015-02-13: Created
+ * @date      2016-02-16: Complete re-write of the code
+ * @date      2026-10-17: splice job files into the driver fifo
+ * @brief     Talk to a printer driver over its pair of fifos
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 
 #include "debug.h"
 #include "printer_driver.h"
+#include "stats.h"
 
 
-int printer_install(struct printer_driver * printer, const char * driver)
+/// The most bytes moved into the driver by a single splice
+#define SPLICE_CHUNK (1024 * 1024)
+/// copy_to_driver() could not write to the driver
+#define COPY_DRIVER_FAILED -1
+/// copy_to_driver() could not read all of the job's file
+#define COPY_FILE_FAILED -2
+
+/**
+ * Wait until a driver endpoint is ready.  The endpoints are non-blocking so
+ * that a stalled driver is only ever waited on here.
+ * @param timeout_ms  how long to wait, or 0 to wait for as long as it takes
+ * @return 0 when the endpoint is ready, or -1 with errno set to ETIMEDOUT if
+ *         the driver stalled or EPIPE if it has gone away
+ */
+static int wait_driver(int fd, short events, int timeout_ms)
+{
+	struct pollfd pfd = { fd, events, 0 };
+	int rc;
+
+	while((rc = poll(&pfd, 1, timeout_ms > 0 ? timeout_ms : -1)) == -1 && errno == EINTR);
+	if(rc == 0)
+	{
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	if(rc == -1 || (pfd.revents & (POLLERR | POLLNVAL)))
+	{
+		errno = EPIPE;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Write a whole set of buffers to the driver
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, struct iovec * iov, int iovcnt, int timeout_ms)
+{
+	ssize_t rc;
+
+	while(iovcnt)
+	{
+		rc = writev(fd, iov, iovcnt);
+		if(rc == -1 && errno == EINTR)
+			continue;
+		if(rc == -1 && errno == EAGAIN)
+		{
+			// the fifo is full, the driver has yet to catch up
+			if(wait_driver(fd, POLLOUT, timeout_ms))
+				return -1;
+			continue;
+		}
+		if(rc == -1)
+			return -1;
+		// skip past whatever was written
+		while(iovcnt && (size_t)rc >= iov->iov_len)
+		{
+			rc -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt)
+		{
+			iov->iov_base = (char*)iov->iov_base + rc;
+			iov->iov_len -= rc;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Send a single line to the driver
+ */
+static int write_line(struct printer_driver * printer, const char * line)
+{
+	struct iovec iov = { (void*)line, strlen(line) };
+	return write_all(printer->driver_write, &iov, 1, printer->write_timeout_ms);
+}
+
+/**
+ * Move the rest of a job's file into the driver, from the printer's write
+ * cursor on.  The data is spliced into the fifo inside the kernel, falling
+ * back to sendfile and then to a plain copy if the file cannot be spliced.
+ * The file may shrink after it was sized, if its owner cuts it short.
+ * @return 0 on success, COPY_DRIVER_FAILED with errno set if the driver could
+ *         not take the data, or COPY_FILE_FAILED if the file ended early or
+ *         could not be read
+ */
+static int copy_to_driver(struct printer_driver * printer, int in)
+{
+	char buffer[4096];
+	int out = printer->driver_write;
+	ssize_t rc;
+	int mode = 0;
+
+	while(printer->remaining > 0)
+	{
+		if(mode == 0)
+			rc = splice(in, &printer->cursor, out, NULL, printer->remaining < SPLICE_CHUNK ? printer->remaining : SPLICE_CHUNK,
+				SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+		else if(mode == 1)
+			rc = sendfile(out, in, &printer->cursor, printer->remaining < SPLICE_CHUNK ? printer->remaining : SPLICE_CHUNK);
+		else
+		{
+			rc = pread(in, buffer, printer->remaining < (off_t)sizeof(buffer) ? printer->remaining : (off_t)sizeof(buffer), printer->cursor);
+			if(rc == -1 && errno != EINTR)
+				return COPY_FILE_FAILED;
+			if(rc > 0)
+			{
+				struct iovec iov = { buffer, rc };
+				if(write_all(out, &iov, 1, printer->write_timeout_ms))
+					return COPY_DRIVER_FAILED;
+				printer->cursor += rc;
+			}
+		}
+		if(rc == -1 && errno == EINTR)
+			continue;
+		if(rc == -1 && errno == EAGAIN)
+		{
+			// the fifo is full, pick up from the cursor once there is room
+			if(wait_driver(out, POLLOUT, printer->write_timeout_ms))
+				return COPY_DRIVER_FAILED;
+			continue;
+		}
+		if(rc == -1 && (errno == EINVAL || errno == ENOSYS) && mode < 2)
+		{
+			// this file cannot be moved that way, try the next method
+			mode++;
+			continue;
+		}
+		// a driver that has gone away shows as a broken pipe, anything else
+		// went wrong with the file
+		if(rc == -1 && errno == EPIPE)
+			return COPY_DRIVER_FAILED;
+		if(rc <= 0)
+			return COPY_FILE_FAILED;
+		printer->remaining -= rc;
+	}
+	return 0;
+}
+
+/**
+ * Read one line from the driver, like fgets.  Whatever the driver sent past
+ * the line is kept for the next call.
+ * @return 0 on success, or -1 with errno set to ETIMEDOUT if the driver did
+ *         not answer in time or EPIPE if it has gone away
+ */
+static int read_line(struct printer_driver * printer, char * line, size_t size, int timeout_ms)
+{
+	char * end;
+	size_t len;
+	ssize_t rc;
+
+	while(1)
+	{
+		end = memchr(printer->reply, '\n', printer->reply_len);
+		if(end || printer->reply_len == sizeof(printer->reply))
+		{
+			len = end ? (size_t)(end - printer->reply) + 1 : printer->reply_len;
+			if(len > size - 1)
+				len = size - 1;
+			memcpy(line, printer->reply, len);
+			line[len] = '\0';
+			printer->reply_len -= len;
+			memmove(printer->reply, printer->reply + len, printer->reply_len);
+			printer->owed--;
+			return 0;
+		}
+		// a driver that has yet to open its end of the -w fifo reads as one
+		// that has gone away, so only read once it has answered
+		if(wait_driver(printer->driver_read, POLLIN, timeout_ms))
+			return -1;
+		rc = read(printer->driver_read, printer->reply + printer->reply_len, sizeof(printer->reply) - printer->reply_len);
+		if(rc > 0)
+			printer->reply_len += rc;
+		else if(rc == 0 || (errno != EAGAIN && errno != EINTR))
+		{
+			errno = EPIPE;
+			return -1;
+		}
+	}
+}
+
+/**
+ * Open the -r fifo of a driver for writing, which only succeeds once the
+ * driver has it open for reading.  The open is retried, backing off from a
+ * millisecond up to 50, until the driver turns up or timeout_ms has passed.
+ * @return the descriptor, or -1 with errno set to ETIMEDOUT if the driver
+ *         never turned up
+ */
+static int open_driver_fifo(const char * path, int timeout_ms)
+{
+	struct timespec now, deadline, backoff = { 0, 1000000 };
+	int fd;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if(deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	while((fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC)) == -1)
+	{
+		if(errno != ENXIO && errno != EINTR)
+			return -1;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(timeout_ms > 0 && (now.tv_sec > deadline.tv_sec ||
+			(now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)))
+		{
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		nanosleep(&backoff, NULL);
+		backoff.tv_nsec = backoff.tv_nsec < 25000000L ? backoff.tv_nsec * 2 : 50000000L;
+	}
+	return fd;
+}
+
+/**
+ * Open both fifos of a driver, without blocking.  The -r fifo is opened
+ * first, as the driver opens it first; the -w fifo can then be opened
+ * straight away, and the driver's answers are waited for in read_line().
+ * @param timeout_ms  how long to wait for the driver to open its fifos, or 0
+ *                    to wait for as long as it takes
+ * @return 0 on success, -1 on error
+ */
+static int open_driver(struct printer_driver * printer, const char * driver, int timeout_ms)
 {
-	int i = 0;
 	char driver_name[500];
-	char line[1024];
+
 	snprintf(driver_name, 500, "%s-r", driver);
-	printer->driver_write = fopen(driver_name, "w");
-	if(printer->driver_write == NULL)
+	printer->driver_write = open_driver_fifo(driver_name, timeout_ms);
+	if(printer->driver_write == -1)
+		return -1;
+
+	snprintf(driver_name, 500, "%s-w", driver);
+	printer->driver_read = open(driver_name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(printer->driver_read == -1)
 	{
-		eprintf("Failed to open printer driver %s\n", driver);
+		close(printer->driver_write);
 		return -1;
 	}
+	printer->reply_len = 0;
+	printer->owed = 0;
+	printer->broken = 0;
+	printer->lost = 0;
+	printer->cut = 0;
+	printer->bad_file = 0;
+	return 0;
+}
 
-	snprintf(driver_name, 500, "%s-w", driver);
-	printer->driver_read = fopen(driver_name, "r");
-	if(printer->driver_read == NULL)
+int printer_running(const char * driver)
+{
+	char driver_name[500];
+	int fd;
+
+	// opening a fifo for writing without blocking only works if something
+	// has it open for reading
+	snprintf(driver_name, 500, "%s-r", driver);
+	fd = open(driver_name, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if(fd == -1)
+		return 0;
+	close(fd);
+	return 1;
+}
+
+int printer_install(struct printer_driver * printer, const char * driver)
+{
+	char ** answers[] = { &printer->name, &printer->description, &printer->location };
+	char line[1024];
+	size_t i;
+
+	if(open_driver(printer, driver, printer->install_timeout_ms))
 	{
 		eprintf("Failed to open printer driver %s\n", driver);
 		return -1;
 	}
 
-	fprintf(printer->driver_write, "##NAME##\n");
-	fflush(printer->driver_write);
 	printer->name = NULL;
-	fgets(line, 1024, printer->driver_read);
-	i = strlen(line);
-	line[i - 1] = '\0';
-	printer->name = strdup(line);
-
-	fprintf(printer->driver_write, "##DESCRIPTION##\n");
-	fflush(printer->driver_write);
 	printer->description = NULL;
-	fgets(line, 1024, printer->driver_read);
-	i = strlen(line);
-	line[i - 1] = '\0';
-	printer->description = strdup(line);
-
-	fprintf(printer->driver_write, "##LOCATION##\n");
-	fflush(printer->driver_write);
 	printer->location = NULL;
-	fgets(line, 1024, printer->driver_read);
-	i = strlen(line);
-	line[i - 1] = '\0';
-	printer->location = strdup(line);
+	// the questions go out in one write, and the driver answers them in turn
+	if(write_line(printer, "##NAME##\n##DESCRIPTION##\n##LOCATION##\n"))
+		goto lost;
+	printer->owed += 3;
+	for(i = 0; i < 3; i++)
+	{
+		if(read_line(printer, line, sizeof(line), printer->install_timeout_ms))
+			goto lost;
+		line[strcspn(line, "\n")] = '\0';
+		*answers[i] = strdup(line);
+	}
+	printer->path = strdup(driver);
 
 	dprintf("Installed Printer:\n"
 					"\tDriver: %s\n"
@@ -61,6 +339,14 @@ int printer_install(struct printer_driver * printer, const char * driver)
 					driver, printer->name, printer->description, printer->location);
 	
 	return 0;
+
+lost:
+	eprintf("Lost printer driver %s while installing it\n", driver);
+	free(printer->name);
+	free(printer->description);
+	close(printer->driver_write);
+	close(printer->driver_read);
+	return -1;
 }
 
 int printer_uninstall(struct printer_driver * printer)
@@ -68,30 +354,188 @@ int printer_uninstall(struct printer_driver * printer)
 	free(printer->name);
 	free(printer->description);
 	free(printer->location);
-	fclose(printer->driver_write);
-	fclose(printer->driver_read);
+	free(printer->path);
+	close(printer->driver_write);
+	close(printer->driver_read);
 	memset(printer, 0, sizeof(struct printer_driver));
 	return 0;
 }
 
-int printer_print(const struct printer_driver * printer, const struct print_job * job)
+/**
+ * Note how a driver let a job down, so printer_recover() knows what it has
+ * to put right
+ * @return PRINTER_DRIVER_FAILED
+ */
+static int driver_failed(struct printer_driver * printer, const struct print_job * job, int cut)
+{
+	printer->broken = 1;
+	if(errno == ETIMEDOUT)
+	{
+		eprintf("Printer %s timed out printing %s\n", printer->name, job->job_name);
+		printer->cut |= cut;
+	}
+	else
+	{
+		eprintf("Lost printer driver %s while printing %s\n", printer->name, job->job_name);
+		printer->lost = 1;
+	}
+	return PRINTER_DRIVER_FAILED;
+}
+
+int printer_print(struct printer_driver * printer, struct print_job * job)
 {
-	char buffer[1024];
-	FILE* ps = fopen(job->file_name, "r");
-	if(!ps)
+	char header[1024];
+	char ack[64];
+	char last = '\n';
+	struct iovec iov[2];
+	struct stat st;
+	int rv;
+	int ps;
+
+	// use the descriptor the client handed over if there is one
+	printer->bad_file = 1;
+	ps = job->fd != -1 ? job->fd : open(job->file_name, O_RDONLY | O_CLOEXEC);
+	if(ps == -1)
 	{
 		eprintf("Failed to open print job file %s\n", job->file_name);
-		return -1;
+		return PRINTER_JOB_FAILED;
 	}
-	
-	fprintf(printer->driver_write, "##NAME: %s##\n", job->job_name);
-	while(fgets(buffer, 1024, ps))
+	if(fstat(ps, &st))
 	{
-		fputs(buffer, printer->driver_write);
+		eprintf("Failed to stat print job file %s\n", job->file_name);
+		if(ps != job->fd)
+			close(ps);
+		return PRINTER_JOB_FAILED;
 	}
-	fprintf(printer->driver_write, "##END##\n");
-	fflush(printer->driver_write);
+	printer->bad_file = 0;
 	
+	iov[0].iov_base = header;
+	iov[0].iov_len = snprintf(header, sizeof(header), "##NAME: %s##\n", job->job_name);
+	if(iov[0].iov_len >= sizeof(header))
+		iov[0].iov_len = sizeof(header) - 1;
+	rv = write_all(printer->driver_write, iov, 1, printer->write_timeout_ms);
+	if(rv == 0)
+	{
+		job->first_byte_ns = stats_now_ns();
+		printer->cursor = 0;
+		printer->remaining = st.st_size;
+		rv = copy_to_driver(printer, ps);
+	}
+	if(rv == COPY_FILE_FAILED)
+	{
+		// the owner cut the file short, or it could not be read; the job
+		// is ended as it stands and fails, and the driver keeps in step
+		eprintf("Print job file %s ended early or could not be read\n", job->file_name);
+		printer->bad_file = 1;
+		rv = 0;
+	}
+	if(rv)
+	{
+		rv = errno;
+		if(ps != job->fd)
+			close(ps);
+		errno = rv;
+		return driver_failed(printer, job, 1);
+	}
+
+	// the driver reads lines, so the trailer must start on a line of its own
+	if(printer->bad_file)
+		last = 0;
+	else if(st.st_size > 0 && pread(ps, &last, 1, st.st_size - 1) != 1)
+		last = '\n';
+	if(ps != job->fd)
+		close(ps);
+	iov[0].iov_base = "\n";
+	iov[0].iov_len = last == '\n' ? 0 : 1;
+	iov[1].iov_base = "##END##\n";
+	iov[1].iov_len = 8;
+	if(write_all(printer->driver_write, iov, 2, printer->write_timeout_ms))
+		return driver_failed(printer, job, 1);
+	printer->owed++;
+
+	// the driver answers once the job has really been printed
+	if(read_line(printer, ack, sizeof(ack), printer->ack_timeout_ms))
+		return driver_failed(printer, job, 0);
+	job->complete_ns = stats_now_ns();
+	if(printer->bad_file)
+		return PRINTER_JOB_FAILED;
+	if(strcmp(ack, "##DONE##\n") == 0)
+		return PRINTER_OK;
+	if(strcmp(ack, "##FAILED##\n") == 0)
+	{
+		eprintf("Printer %s failed to print %s\n", printer->name, job->job_name);
+		return PRINTER_JOB_FAILED;
+	}
+	// the job may yet print on a printer whose driver makes sense
+	eprintf("Printer %s gave a bad answer to %s\n", printer->name, job->job_name);
+	return PRINTER_DRIVER_FAILED;
+}
+
+/**
+ * Check whether the driver's fifo was made anew, by a driver started again
+ * while a child of the old one still holds the old fifo open
+ * @return 1 if the fifo on disk is not the one that is open
+ */
+static int driver_replaced(struct printer_driver * printer)
+{
+	char driver_name[500];
+	struct stat on_disk, open_now;
+
+	snprintf(driver_name, 500, "%s-r", printer->path);
+	if(stat(driver_name, &on_disk) || fstat(printer->driver_write, &open_now))
+		return 0;
+	return on_disk.st_dev != open_now.st_dev || on_disk.st_ino != open_now.st_ino;
+}
+
+int printer_recover(struct printer_driver * printer)
+{
+	char line[1024];
+
+	if(!printer->lost && driver_replaced(printer))
+		printer->lost = 1;
+	if(printer->lost)
+	{
+		// the driver went away, it may have been started again since
+		if(!printer_running(printer->path))
+			return -1;
+		close(printer->driver_write);
+		close(printer->driver_read);
+		if(open_driver(printer, printer->path, printer->install_timeout_ms))
+		{
+			// keep descriptors that can be closed again next time
+			printer->driver_write = printer->driver_read = -1;
+			printer->lost = 1;
+			return -1;
+		}
+	}
+	else if(printer->cut)
+	{
+		// end the job that was cut off so the driver listens again
+		if(write_line(printer, "\n##END##\n"))
+			goto failed;
+		printer->cut = 0;
+		printer->owed++;
+	}
+
+	// the driver is well once it answers, after the answers it still owes
+	// for jobs and earlier tries that were given up on
+	if(printer->owed == 0)
+	{
+		if(write_line(printer, "##NAME##\n"))
+			goto failed;
+		printer->owed++;
+	}
+	while(printer->owed > 0)
+	{
+		if(read_line(printer, line, sizeof(line), printer->ack_timeout_ms))
+			goto failed;
+	}
+	printer->broken = 0;
 	return 0;
+
+failed:
+	if(errno != ETIMEDOUT)
+		printer->lost = 1;
+	return -1;
 }
 
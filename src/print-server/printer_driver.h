@@ -20,6 +20,8 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 #ifndef PRINTER_H
 #define PRINTER_H
 
+#include <sys/types.h>
+
 #include "print_job.h"
 
 #ifdef __cplusplus
@@ -38,18 +40,59 @@ struct printer_driver
 	char * description;
 	// the location of the printer
 	char * location;
-	// the write endpoint to talk to the driver
-	FILE * driver_write;
-	// the read endpoint to query the driver
-	FILE * driver_read;
+	// the write endpoint to talk to the driver, the -r fifo, non-blocking
+	int driver_write;
+	// the read endpoint to query the driver, the -w fifo, non-blocking
+	int driver_read;
+	// what the driver has sent that is not a whole line yet
+	char reply[128];
+	size_t reply_len;
+	// answers the driver has yet to send, one per job and question
+	int owed;
+	// the job file being written to the driver: the offset to go on from
+	// once the fifo has room again, and the bytes still to go
+	off_t cursor;
+	off_t remaining;
+	// how long the driver may take to make room for more of a job, and to
+	// answer once it has all of it; 0 waits for as long as it takes
+	int write_timeout_ms;
+	int ack_timeout_ms;
+	// how long the driver may take to open its fifos, and to answer each
+	// install question; 0 waits for as long as it takes
+	int install_timeout_ms;
+	// the driver timed out or went away, and needs printer_recover()
+	int broken;
+	// the driver went away, its fifos have to be opened again
+	int lost;
+	// a job was cut off part way, the driver has to be told it has ended
+	int cut;
+	// the last job failed because its file could not be read, which says
+	// nothing about the driver
+	int bad_file;
+	// the fifos, without the -r or -w
+	char * path;
 };
 
+/// printer_print() printed the job
+#define PRINTER_OK 0
+/// printer_print() could not read the job, in which case bad_file is set, or
+/// the driver answered that it failed to print it; it would fail on any
+/// printer
+#define PRINTER_JOB_FAILED -1
+/// the driver timed out, went away or answered with garbage; another printer
+/// may still print the job
+#define PRINTER_DRIVER_FAILED -2
+
 // install a new driver
 int printer_install(struct printer_driver * printer, const char * driver);
 // uninstall the given driver
 int printer_uninstall(struct printer_driver * printer);
 // send a print job to the driver
-int printer_print(const struct printer_driver * printer, const struct print_job * job);
+int printer_print(struct printer_driver * printer, struct print_job * job);
+// check that a driver that timed out or went away answers again
+int printer_recover(struct printer_driver * printer);
+// check whether a driver is running, without blocking
+int printer_running(const char * driver);
 
 #ifdef __cplusplus
 }
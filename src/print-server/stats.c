@@ -0,0 +1,96 @@
+/**
+ * @file      stats.c
+ * @date      2026-10-17: Created
+ * @brief     Lock-free counters and latency histograms for the STATS request
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "stats.h"
+
+uint64_t stats_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * The bucket a value falls in.  Values below HIST_SUB get a bucket each,
+ * above that every power of two gets HIST_SUB buckets.
+ */
+static unsigned bucket_of(uint64_t v)
+{
+	unsigned shift;
+
+	if(v < HIST_SUB)
+		return v;
+	shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB + ((v >> shift) & (HIST_SUB - 1));
+}
+
+/**
+ * The largest value that falls in a bucket
+ */
+static uint64_t bucket_max(unsigned b)
+{
+	unsigned shift;
+
+	if(b < HIST_SUB)
+		return b;
+	shift = b / HIST_SUB - 1;
+	return ((uint64_t)(HIST_SUB + b % HIST_SUB + 1) << shift) - 1;
+}
+
+void histogram_record(struct histogram * h, uint64_t ns)
+{
+	atomic_fetch_add_explicit(&h->buckets[bucket_of(ns)], 1, memory_order_relaxed);
+}
+
+/**
+ * Two lines per histogram: the count and percentiles, then each non-empty
+ * bucket as upper bound in microseconds and count.  The buckets are read
+ * one at a time while printers keep recording, so the two lines may
+ * disagree by a job or two.
+ */
+void histogram_print(FILE * out, const char * label, const char * group, const struct histogram * h)
+{
+	static const double percentiles[] = { 0.5, 0.9, 0.99, 1.0 };
+	static const char * names[] = { "p50", "p90", "p99", "max" };
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t total = 0;
+	uint64_t seen = 0;
+	unsigned b, p = 0;
+
+	for(b = 0; b < HIST_BUCKETS; b++)
+		total += counts[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+
+	fprintf(out, "%s %s count=%llu", label, group, (unsigned long long)total);
+	for(b = 0; b < HIST_BUCKETS && total; b++)
+	{
+		seen += counts[b];
+		while(p < 4 && seen && seen >= percentiles[p] * total)
+			fprintf(out, " %s_us=%.1f", names[p++], bucket_max(b) / 1000.0);
+	}
+	fprintf(out, "\n%s_hist %s", label, group);
+	for(b = 0; b < HIST_BUCKETS; b++)
+	{
+		if(counts[b])
+			fprintf(out, " %.1f:%llu", bucket_max(b) / 1000.0, (unsigned long long)counts[b]);
+	}
+	fprintf(out, "\n");
+}
+
@@ -0,0 +1,97 @@
+/**
+ * @file      stats.h
+ * @date      2026-10-17: Created
+ * @brief     Lock-free counters and latency histograms for the STATS request
+ * @copyright MIT License (c) 2015, 2016
+ */
+ 
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+/// Each power of two is split into 2^HIST_SUB_BITS buckets, about 12% wide
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+/// Enough buckets for any 64 bit count of nanoseconds
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+/**
+ * A log-linear histogram of durations in nanoseconds, in the style of
+ * HdrHistogram.  Recording is a single relaxed atomic add.
+ */
+struct histogram
+{
+	atomic_uint_least64_t buckets[HIST_BUCKETS];
+};
+
+/**
+ * The counters kept for each printer group
+ */
+struct group_stats
+{
+	// jobs pushed onto and popped off the group's queue
+	atomic_uint_least64_t enqueued;
+	atomic_uint_least64_t dequeued;
+	// jobs turned away because the queue was full
+	atomic_uint_least64_t rejected;
+	// jobs put back on the queue after a printer failed them
+	atomic_uint_least64_t requeued;
+	// time from enqueue to a printer taking the job
+	struct histogram wait;
+	// time from a printer taking the job to it being printed
+	struct histogram print;
+	// jobs cancelled before a printer took them, and jobs held back by a
+	// pause right now, both only touched by the main thread
+	uint64_t cancelled;
+	uint64_t paused;
+	// the counts at the last STATS request, only touched by the main thread
+	uint64_t last_enqueued;
+	uint64_t last_dequeued;
+};
+
+/**
+ * The counters kept for each printer
+ */
+struct printer_stats
+{
+	atomic_uint_least64_t jobs;
+	atomic_uint_least64_t bytes;
+	// jobs whose output was copied from the output cache
+	atomic_uint_least64_t cache_hits;
+	// time spent printing
+	atomic_uint_least64_t busy_ns;
+	// jobs the printer failed, and whether it is tripped and kept off the
+	// queue until its driver answers again
+	atomic_uint_least64_t failed;
+	atomic_int tripped;
+};
+
+// the monotonic clock in nanoseconds
+uint64_t stats_now_ns(void);
+// add one duration to a histogram
+void histogram_record(struct histogram * h, uint64_t ns);
+// write a summary and the non-empty buckets of a histogram
+void histogram_print(FILE * out, const char * label, const char * group, const struct histogram * h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,251 @@
+/**
+ * @file      test_job_index.c
+ * @date      2026-10-17: Created
+ * @brief     Check that jobs added to the job index are found until removed
+ * @copyright MIT License (c) 2015, 2016
+ *
+ * Fills the job index until it grows several times, removes jobs from runs
+ * of colliding job numbers, including runs that wrap past the end of the
+ * table, then adds and removes random jobs against a plain array.  After
+ * each step every job in the index must be found, and no other.  Build and
+ * run with `make check`; the exit status is non-zero if any check failed.
+ */
+
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "job_index.h"
+
+/// The number of jobs added by the growth check
+#define GROW_JOBS 100000
+/// The job numbers used by the random check, and the operations it does
+#define RANDOM_RANGE 5000
+#define RANDOM_OPS 1000000
+/// The number of colliding jobs in each run
+#define RUN_LENGTH 6
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+/**
+ * The job a test stores under a job number; never touched, only compared
+ */
+static struct print_job * job_of(long long job_number)
+{
+	return (struct print_job*)(size_t)(job_number * 16 + 8);
+}
+
+/**
+ * Every entry in use must be the one found for its job number, and the
+ * count must match them
+ */
+static void check_entries(struct job_index * index)
+{
+	struct job_entry * e;
+	size_t i, used = 0;
+
+	if(index->entries == NULL)
+		return;
+	for(i = 0; i <= index->mask; i++)
+	{
+		e = &index->entries[i];
+		if(e->job_number == -1)
+			continue;
+		used++;
+		CHECK(job_index_find(index, e->job_number) == e);
+		CHECK(e->job == job_of(e->job_number));
+	}
+	CHECK(used == index->count);
+	// never more than half full
+	CHECK(2 * index->count <= index->mask + 1);
+}
+
+static void remove_job(struct job_index * index, long long job_number)
+{
+	struct job_entry * e = job_index_find(index, job_number);
+
+	CHECK(e != NULL);
+	if(e)
+		job_index_remove(index, e);
+}
+
+static void check_grow()
+{
+	struct job_index index;
+	struct job_entry * e;
+	long long i;
+	size_t size = 0;
+	int grown = 0;
+
+	memset(&index, 0, sizeof(index));
+	CHECK(job_index_find(&index, 1) == NULL);
+	for(i = 0; i < GROW_JOBS; i++)
+	{
+		CHECK(job_index_insert(&index, i, job_of(i)) == 0);
+		if(index.mask + 1 != size)
+		{
+			size = index.mask + 1;
+			grown++;
+		}
+	}
+	CHECK(index.count == GROW_JOBS);
+	CHECK(grown > 5);
+	check_entries(&index);
+	for(i = 0; i < GROW_JOBS; i++)
+	{
+		e = job_index_find(&index, i);
+		CHECK(e && e->job_number == i && e->job == job_of(i) && e->waiters == NULL);
+	}
+	CHECK(job_index_find(&index, GROW_JOBS) == NULL);
+	CHECK(job_index_find(&index, -5) == NULL);
+
+	// remove every other job, the rest are still found
+	for(i = 0; i < GROW_JOBS; i += 2)
+		remove_job(&index, i);
+	CHECK(index.count == GROW_JOBS / 2);
+	check_entries(&index);
+	for(i = 0; i < GROW_JOBS; i++)
+		CHECK((job_index_find(&index, i) != NULL) == (i % 2));
+	job_index_destroy(&index);
+	CHECK(index.entries == NULL && index.count == 0);
+}
+
+/**
+ * Find RUN_LENGTH job numbers whose home is slot home of a new index
+ */
+static void find_run(long long * numbers, size_t home)
+{
+	struct job_index index;
+	long long i;
+	int n = 0;
+
+	memset(&index, 0, sizeof(index));
+	for(i = 0; n < RUN_LENGTH; i++)
+	{
+		job_index_insert(&index, i, job_of(i));
+		if((size_t)(job_index_find(&index, i) - index.entries) == home)
+			numbers[n++] = i;
+		job_index_remove(&index, job_index_find(&index, i));
+	}
+	job_index_destroy(&index);
+}
+
+/**
+ * Remove jobs from the middle of a run of colliding jobs, with and without
+ * the run wrapping past the last slot, and with jobs from the next slot's
+ * run mixed in
+ */
+static void check_runs()
+{
+	struct job_index index;
+	long long last[RUN_LENGTH], first[RUN_LENGTH];
+	int i, j;
+
+	memset(&index, 0, sizeof(index));
+	// an index with one job in it has the size every new index starts at
+	job_index_insert(&index, 0, job_of(0));
+	find_run(last, index.mask);
+	find_run(first, 0);
+	job_index_destroy(&index);
+
+	for(j = 0; j < RUN_LENGTH; j++)
+	{
+		memset(&index, 0, sizeof(index));
+		for(i = 0; i < RUN_LENGTH; i++)
+		{
+			CHECK(job_index_insert(&index, last[i], job_of(last[i])) == 0);
+			CHECK(job_index_insert(&index, first[i], job_of(first[i])) == 0);
+		}
+		// the run homed on the last slot wraps round to the first
+		CHECK(job_index_find(&index, last[RUN_LENGTH - 1]) < index.entries + RUN_LENGTH * 2);
+		remove_job(&index, last[j]);
+		remove_job(&index, first[j]);
+		check_entries(&index);
+		for(i = 0; i < RUN_LENGTH; i++)
+		{
+			CHECK((job_index_find(&index, last[i]) == NULL) == (i == j));
+			CHECK((job_index_find(&index, first[i]) == NULL) == (i == j));
+		}
+		job_index_destroy(&index);
+	}
+}
+
+/**
+ * Add and remove random jobs, checking each lookup against a plain array
+ */
+static void check_random()
+{
+	struct job_index index;
+	struct job_entry * e;
+	char * in;
+	long long n;
+	size_t count = 0;
+	int i;
+
+	in = calloc(RANDOM_RANGE, 1);
+	if(in == NULL)
+	{
+		CHECK(!"out of memory");
+		return;
+	}
+	memset(&index, 0, sizeof(index));
+	srand(308);
+	for(i = 0; i < RANDOM_OPS; i++)
+	{
+		n = rand() % RANDOM_RANGE;
+		e = job_index_find(&index, n);
+		CHECK((e != NULL) == in[n]);
+		if(e)
+		{
+			CHECK(e->job_number == n && e->job == job_of(n));
+			job_index_remove(&index, e);
+			in[n] = 0;
+			count--;
+		}
+		else if(job_index_insert(&index, n, job_of(n)) == 0)
+		{
+			in[n] = 1;
+			count++;
+		}
+		else
+		{
+			CHECK(!"out of memory");
+		}
+		CHECK(index.count == count);
+		if(i % (RANDOM_OPS / 16) == 0)
+			check_entries(&index);
+	}
+	check_entries(&index);
+	job_index_destroy(&index);
+	free(in);
+}
+
+int main()
+{
+	check_grow();
+	check_runs();
+	check_random();
+	if(failures)
+	{
+		fprintf(stderr, "test_job_index: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("test_job_index: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,369 @@
+/**
+ * @file      test_job_list.c
+ * @date      2026-10-17: Created
+ * @brief     Check the order each print_job_list policy hands jobs out in
+ * @copyright MIT License (c) 2015, 2016
+ *
+ * Runs every scheduling policy through a fixed set of jobs and checks the
+ * order they come back in, cancels, pauses and resumes jobs in each state,
+ * then has several producers and printers share each policy and checks
+ * every job is printed exactly once.  Build and run
+ * with `make check`; the exit status is non-zero if any check failed.
+ */
+
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "print_job_list.h"
+
+/// The number of jobs pushed through each policy by the threaded check
+#define STRESS_JOBS 200000
+/// The number of threads pushing and popping in the threaded check
+#define STRESS_PRODUCERS 3
+#define STRESS_CONSUMERS 4
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+static const struct print_job_list_ops * const policies[] = {
+	&print_job_list_fifo,
+	&print_job_list_ring,
+	&print_job_list_sjf,
+	&print_job_list_rr,
+	&print_job_list_priority,
+};
+
+/**
+ * A job as the tests push it
+ */
+static void make_job(struct print_job * job, long long number, uid_t owner, long long size, int priority)
+{
+	memset(job, 0, sizeof(*job));
+	job->job_number = number;
+	job->owner = owner;
+	job->size = size;
+	job->priority = priority;
+	job->fd = -1;
+}
+
+static int open_list(struct print_job_list * list, const struct print_job_list_ops * ops, size_t capacity)
+{
+	memset(list, 0, sizeof(*list));
+	list->ops = ops;
+	list->capacity = capacity;
+	return print_job_list_init(list);
+}
+
+/**
+ * Push jobs 0 to n-1 and check they are popped in the order given
+ */
+static void check_order(const struct print_job_list_ops * ops, struct print_job * jobs, int n, const int * order)
+{
+	struct print_job_list list;
+	struct print_job * job;
+	int i;
+
+	CHECK(open_list(&list, ops, 0) == 0);
+	for(i = 0; i < n; i++)
+		CHECK(print_job_list_push(&list, &jobs[i]) == 0);
+	for(i = 0; i < n; i++)
+	{
+		job = print_job_list_pop(&list);
+		if(job->job_number != order[i])
+		{
+			fprintf(stderr, "%s: job %d popped where job %d was expected\n", ops->name, (int)job->job_number, order[i]);
+			CHECK(job->job_number == order[i]);
+		}
+	}
+	// an emptied list takes no more from take
+	if(ops->erase)
+		CHECK(print_job_list_take(&list) == NULL);
+	print_job_list_destroy(&list);
+}
+
+static void check_policies()
+{
+	struct print_job jobs[8];
+	// sizes and priorities chosen so each policy gives a different order
+	static const long long sizes[8] = { 500, 100, 300, 100, 800, 200, 300, 50 };
+	static const int priorities[8] = { 0, 5, 0, 9, 5, -1, 9, 0 };
+	// users 1, 1, 1, 2, 2, 3, 1, 3
+	static const uid_t owners[8] = { 1, 1, 1, 2, 2, 3, 1, 3 };
+	static const int fifo[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	static const int sjf[8] = { 7, 1, 3, 5, 2, 6, 0, 4 };
+	static const int priority[8] = { 3, 6, 1, 4, 0, 2, 7, 5 };
+	static const int rr[8] = { 0, 3, 5, 1, 4, 7, 2, 6 };
+	int i;
+
+	for(i = 0; i < 8; i++)
+		make_job(&jobs[i], i, owners[i], sizes[i], priorities[i]);
+	check_order(&print_job_list_fifo, jobs, 8, fifo);
+	check_order(&print_job_list_ring, jobs, 8, fifo);
+	check_order(&print_job_list_sjf, jobs, 8, sjf);
+	check_order(&print_job_list_priority, jobs, 8, priority);
+	check_order(&print_job_list_rr, jobs, 8, rr);
+
+	CHECK(print_job_list_find_ops("rr") == &print_job_list_rr);
+	CHECK(print_job_list_find_ops("lifo") == NULL);
+}
+
+/**
+ * A ring holds as many jobs as its capacity rounded up to a power of two,
+ * and refuses the next
+ */
+static void check_ring_capacity()
+{
+	struct print_job_list list;
+	struct print_job jobs[9];
+	int i;
+
+	CHECK(open_list(&list, &print_job_list_ring, 5) == 0);
+	CHECK(list.capacity == 8);
+	for(i = 0; i < 9; i++)
+		make_job(&jobs[i], i, 0, 0, 0);
+	for(i = 0; i < 8; i++)
+		CHECK(print_job_list_push(&list, &jobs[i]) == 0);
+	CHECK(print_job_list_push(&list, &jobs[8]) == -1);
+	// once one is taken there is room again, and the order holds
+	CHECK(print_job_list_pop(&list) == &jobs[0]);
+	CHECK(print_job_list_push(&list, &jobs[8]) == 0);
+	for(i = 1; i < 9; i++)
+		CHECK(print_job_list_pop(&list) == &jobs[i]);
+	print_job_list_destroy(&list);
+}
+
+static int released;
+
+static void count_release(struct print_job * job)
+{
+	released++;
+}
+
+/**
+ * Pop n jobs and check they are exactly the jobs in want, in any order
+ */
+static void check_pops(struct print_job_list * list, struct print_job * jobs, unsigned want, int n)
+{
+	struct print_job * job;
+	unsigned got = 0;
+	int i;
+
+	for(i = 0; i < n; i++)
+	{
+		job = print_job_list_pop(list);
+		got |= 1u << (job - jobs);
+	}
+	if(got != want)
+		fprintf(stderr, "%s: popped jobs %#x where %#x were expected\n", list->ops->name, got, want);
+	CHECK(got == want);
+}
+
+/**
+ * Cancel, pause and resume jobs in each state.  A ring leaves cancelled and
+ * paused jobs in their cells, so there is always a live job behind them for
+ * the pop that skips them to return.
+ */
+static void check_control(const struct print_job_list_ops * ops)
+{
+	struct print_job_list list;
+	struct print_job jobs[8];
+	// a ring leaves a cancelled job to be released by the printer
+	int left = ops->erase ? 0 : 1;
+	int i;
+
+	CHECK(open_list(&list, ops, 16) == 0);
+	list.release = count_release;
+	released = 0;
+	for(i = 0; i < 8; i++)
+		make_job(&jobs[i], i, 1, 100, 0);
+	for(i = 0; i < 6; i++)
+		CHECK(print_job_list_push(&list, &jobs[i]) == 0);
+
+	CHECK(print_job_list_cancel(&list, &jobs[1]) == left);
+	CHECK(print_job_list_pause(&list, &jobs[2]) == 0);
+	CHECK(print_job_list_pause(&list, &jobs[2]) == 0);
+	// only a paused job can be resumed
+	CHECK(print_job_list_resume(&list, &jobs[3]) == -1);
+	check_pops(&list, jobs, 1 << 0 | 1 << 3 | 1 << 4 | 1 << 5, 4);
+	CHECK(released == left);
+
+	// a job a printer has can be neither cancelled nor paused
+	CHECK(print_job_list_cancel(&list, &jobs[0]) == -1);
+	CHECK(print_job_list_pause(&list, &jobs[0]) == -1);
+
+	// a paused job comes back when resumed, and only once
+	CHECK(print_job_list_resume(&list, &jobs[2]) == 0);
+	CHECK(print_job_list_resume(&list, &jobs[2]) == -1);
+	check_pops(&list, jobs, 1 << 2, 1);
+	CHECK(print_job_list_resume(&list, &jobs[2]) == -1);
+
+	// a ring keeps the place of a job resumed before a printer skipped it
+	CHECK(print_job_list_push(&list, &jobs[6]) == 0);
+	CHECK(print_job_list_push(&list, &jobs[7]) == 0);
+	CHECK(print_job_list_pause(&list, &jobs[6]) == 0);
+	CHECK(print_job_list_resume(&list, &jobs[6]) == 0);
+	check_pops(&list, jobs, 1 << 6 | 1 << 7, 2);
+
+	// a paused job can be cancelled
+	CHECK(print_job_list_push(&list, &jobs[6]) == 0);
+	CHECK(print_job_list_push(&list, &jobs[7]) == 0);
+	CHECK(print_job_list_pause(&list, &jobs[6]) == 0);
+	CHECK(print_job_list_cancel(&list, &jobs[6]) == left);
+	CHECK(print_job_list_resume(&list, &jobs[6]) == -1);
+	check_pops(&list, jobs, 1 << 7, 1);
+	CHECK(released == 2 * left);
+
+	print_job_list_destroy(&list);
+}
+
+struct stress
+{
+	struct print_job_list list;
+	struct print_job * jobs;
+	// how often each job was popped, and how many pops there were
+	int * popped;
+	long total;
+};
+
+struct producer
+{
+	struct stress * stress;
+	int index;
+};
+
+static void * stress_producer(void * arg)
+{
+	struct producer * p = arg;
+	long i;
+
+	for(i = p->index; i < STRESS_JOBS; i += STRESS_PRODUCERS)
+	{
+		// a ring may be momentarily full
+		while(print_job_list_push(&p->stress->list, &p->stress->jobs[i]))
+			sched_yield();
+	}
+	return NULL;
+}
+
+static void * stress_consumer(void * arg)
+{
+	struct stress * s = arg;
+	struct print_job * job;
+
+	// a job with a negative number tells the consumer to stop
+	while((job = print_job_list_pop(&s->list))->job_number >= 0)
+	{
+		__atomic_fetch_add(&s->popped[job->job_number], 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&s->total, 1, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+/**
+ * Several producers and printers share a list; every job must come out once
+ */
+static void check_threads(const struct print_job_list_ops * ops)
+{
+	struct stress s;
+	struct producer producers[STRESS_PRODUCERS];
+	struct print_job stop[STRESS_CONSUMERS];
+	pthread_t producer_tids[STRESS_PRODUCERS], consumer_tids[STRESS_CONSUMERS];
+	long i, missing = 0, twice = 0;
+	time_t deadline;
+
+	s.jobs = malloc(STRESS_JOBS * sizeof(struct print_job));
+	s.popped = calloc(STRESS_JOBS, sizeof(int));
+	s.total = 0;
+	if(s.jobs == NULL || s.popped == NULL)
+	{
+		CHECK(!"out of memory");
+		return;
+	}
+	for(i = 0; i < STRESS_JOBS; i++)
+		make_job(&s.jobs[i], i, i % 7, i % 1000, i % 5);
+	CHECK(open_list(&s.list, ops, 1024) == 0);
+
+	for(i = 0; i < STRESS_CONSUMERS; i++)
+		pthread_create(&consumer_tids[i], NULL, stress_consumer, &s);
+	for(i = 0; i < STRESS_PRODUCERS; i++)
+	{
+		producers[i].stress = &s;
+		producers[i].index = i;
+		pthread_create(&producer_tids[i], NULL, stress_producer, &producers[i]);
+	}
+	for(i = 0; i < STRESS_PRODUCERS; i++)
+		pthread_join(producer_tids[i], NULL);
+	// round robin would hand out a stop job before the others, so the
+	// consumers are only stopped once everything is out
+	deadline = time(NULL) + 60;
+	while(__atomic_load_n(&s.total, __ATOMIC_ACQUIRE) < STRESS_JOBS)
+	{
+		if(time(NULL) > deadline)
+		{
+			// the printers are stuck in pop, and cannot be stopped
+			fprintf(stderr, "%s: only %ld of %d jobs popped\n", ops->name, s.total, STRESS_JOBS);
+			exit(1);
+		}
+		sched_yield();
+	}
+	for(i = 0; i < STRESS_CONSUMERS; i++)
+	{
+		make_job(&stop[i], -1, 0, 0, 0);
+		while(print_job_list_push(&s.list, &stop[i]))
+			sched_yield();
+	}
+	for(i = 0; i < STRESS_CONSUMERS; i++)
+		pthread_join(consumer_tids[i], NULL);
+
+	for(i = 0; i < STRESS_JOBS; i++)
+	{
+		if(s.popped[i] == 0)
+			missing++;
+		else if(s.popped[i] > 1)
+			twice++;
+	}
+	if(missing || twice)
+		fprintf(stderr, "%s: %ld jobs never popped, %ld popped more than once\n", ops->name, missing, twice);
+	CHECK(missing == 0 && twice == 0);
+	print_job_list_destroy(&s.list);
+	free(s.jobs);
+	free(s.popped);
+}
+
+int main()
+{
+	size_t i;
+
+	check_policies();
+	check_ring_capacity();
+	for(i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+		check_control(policies[i]);
+	for(i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+		check_threads(policies[i]);
+	if(failures)
+	{
+		fprintf(stderr, "test_job_list: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("test_job_list: all checks passed\n");
+	return 0;
+}
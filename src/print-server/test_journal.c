@@ -0,0 +1,282 @@
+/**
+ * @file      test_journal.c
+ * @date      2026-10-17: Created
+ * @brief     Check the jobs a journal gives back when it is opened again
+ * @copyright MIT License (c) 2015, 2016
+ *
+ * Journals jobs in a scratch directory, closes the journal and opens it
+ * again, and checks that exactly the unfinished jobs come back with their
+ * fields, in the order they were submitted, and that job numbers are never
+ * handed out twice.  Then damages the last record, as a crash part way
+ * through writing it would, and has the journal compacted while it runs.
+ * Build and run with `make check`; the exit status is non-zero if any check
+ * failed.
+ */
+
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "job_pool.h"
+#include "journal.h"
+
+/// The number of jobs journaled while the journal is compacted
+#define COMPACT_JOBS 20000
+/// The size the journal is compacted at in that check
+#define COMPACT_BYTES (64 * 1024)
+/// The most jobs a check expects back
+#define MAX_RECOVERED 64
+
+int verbose_flag = 0;
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+static char path[64];
+
+/**
+ * The jobs handed back by the journal as it is opened
+ */
+struct recovered
+{
+	long long numbers[MAX_RECOVERED];
+	int count;
+	// a job number the server no longer takes, or -1
+	long long drop;
+};
+
+/**
+ * The group a test job is journaled under
+ */
+static const char * group_of(long long number)
+{
+	return number % 2 ? "color" : "black_white";
+}
+
+static void submit(long long number)
+{
+	struct print_job job;
+	char name[32];
+
+	memset(&job, 0, sizeof(job));
+	snprintf(name, sizeof(name), "job%lld.ps", number);
+	job.job_number = number;
+	job.priority = number % 5 - 2;
+	job.owner = 1000 + number % 3;
+	job.size = number * 100;
+	job.job_name = name;
+	// every third job has no description
+	job.description = number % 3 ? "a description" : NULL;
+	job.file_name = name;
+	journal_submitted(&job, group_of(number));
+}
+
+static int recover(struct print_job * job, const char * group, size_t group_len, void * arg)
+{
+	struct recovered * r = arg;
+	char name[32];
+	long long n = job->job_number;
+
+	snprintf(name, sizeof(name), "job%lld.ps", n);
+	CHECK(group_len == strlen(group_of(n)) && memcmp(group, group_of(n), group_len) == 0);
+	CHECK(job->priority == n % 5 - 2);
+	CHECK(job->owner == 1000 + n % 3);
+	CHECK(job->size == n * 100);
+	CHECK(job->job_name && strcmp(job->job_name, name) == 0);
+	CHECK(job->file_name && strcmp(job->file_name, name) == 0);
+	if(n % 3)
+		CHECK(job->description && strcmp(job->description, "a description") == 0);
+	else
+		CHECK(job->description == NULL);
+
+	if(r->count < MAX_RECOVERED)
+		r->numbers[r->count] = n;
+	r->count++;
+	job_pool_free(job);
+	return n == r->drop ? -1 : 0;
+}
+
+/**
+ * Open the journal and check the jobs it gives back, and the next job number
+ */
+static void reopen(size_t compact_bytes, const long long * want, int count, long long drop, long long next)
+{
+	struct recovered r;
+	long long next_job_number = 0;
+	int i;
+
+	r.count = 0;
+	r.drop = drop;
+	CHECK(journal_open(path, compact_bytes, recover, &r, &next_job_number) == 0);
+	CHECK(r.count == count);
+	for(i = 0; i < count && i < r.count; i++)
+	{
+		if(r.numbers[i] != want[i])
+		{
+			fprintf(stderr, "job %lld recovered where job %lld was expected\n", r.numbers[i], want[i]);
+			CHECK(r.numbers[i] == want[i]);
+		}
+	}
+	if(next_job_number != next)
+		fprintf(stderr, "next job number %lld where %lld was expected\n", next_job_number, next);
+	CHECK(next_job_number == next);
+}
+
+static void check_recovery()
+{
+	static const long long unfinished[] = { 1, 3, 5, 7, 9 };
+	static const long long kept[] = { 1, 3, 5, 7 };
+	long long i;
+
+	unlink(path);
+	reopen(1 << 20, NULL, 0, -1, 0);
+	for(i = 1; i <= 10; i++)
+		submit(i);
+	// being dispatched does not finish a job
+	journal_dispatched(2);
+	journal_dispatched(3);
+	for(i = 2; i <= 10; i += 2)
+		journal_finished(i);
+	// nor does finishing a job that was never submitted
+	journal_finished(42);
+	journal_close();
+
+	// job 9 is dropped, so it is left out of the compacted journal
+	reopen(1 << 20, unfinished, 5, 9, 43);
+	journal_close();
+	reopen(1 << 20, kept, 4, -1, 43);
+	journal_close();
+
+	// the numbers of jobs finished and compacted away are not used again
+	reopen(1 << 20, kept, 4, -1, 43);
+	for(i = 1; i <= 7; i += 2)
+		journal_finished(i);
+	journal_close();
+	reopen(1 << 20, NULL, 0, -1, 43);
+	journal_close();
+	reopen(1 << 20, NULL, 0, -1, 43);
+	journal_close();
+}
+
+/**
+ * A crash while a record is written leaves it torn; the replay stops before
+ * it and keeps everything before it.
+ */
+static void check_torn_record()
+{
+	static const long long unfinished[] = { 44, 45 };
+	struct stat st;
+	char * buf;
+	ssize_t len;
+	int fd;
+
+	reopen(1 << 20, NULL, 0, -1, 43);
+	submit(43);
+	submit(44);
+	submit(45);
+	journal_finished(43);
+	journal_finished(45);
+	journal_close();
+
+	// the last record, finishing job 45, ends with the last byte that is not
+	// padding; change it
+	fd = open(path, O_RDWR);
+	CHECK(fd != -1);
+	if(fd == -1)
+		return;
+	CHECK(fstat(fd, &st) == 0);
+	buf = malloc(st.st_size);
+	CHECK(buf != NULL);
+	if(buf == NULL)
+	{
+		close(fd);
+		return;
+	}
+	CHECK(pread(fd, buf, st.st_size, 0) == st.st_size);
+	for(len = st.st_size; len > 0 && buf[len - 1] == 0; len--);
+	CHECK(len > 16);
+	buf[len - 1] ^= 0x55;
+	CHECK(pwrite(fd, buf + len - 1, 1, len - 1) == 1);
+	free(buf);
+	close(fd);
+
+	reopen(1 << 20, unfinished, 2, -1, 46);
+	journal_close();
+}
+
+/**
+ * Journal many short lived jobs with a small compaction size, so the
+ * committer compacts the journal over and over while jobs are appended.
+ */
+static void check_compaction()
+{
+	long long want[MAX_RECOVERED];
+	struct stat st;
+	long long i;
+	int n = 0;
+
+	unlink(path);
+	reopen(COMPACT_BYTES, NULL, 0, -1, 0);
+	for(i = 1; i <= COMPACT_JOBS; i++)
+	{
+		submit(i);
+		// a few jobs stay unfinished
+		if(i % (COMPACT_JOBS / 16))
+			journal_finished(i);
+		else
+			want[n++] = i;
+	}
+	journal_close();
+
+	// the journal never grew near the size all those records would take
+	CHECK(stat(path, &st) == 0);
+	CHECK(st.st_size <= 2 * 1024 * 1024);
+	reopen(COMPACT_BYTES, want, n, -1, COMPACT_JOBS + 1);
+	journal_close();
+}
+
+int main()
+{
+	char dir[] = "/tmp/test_journal.XXXXXX";
+	char new_path[80];
+
+	if(mkdtemp(dir) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/journal", dir);
+	check_recovery();
+	check_torn_record();
+	check_compaction();
+
+	unlink(path);
+	snprintf(new_path, sizeof(new_path), "%s.new", path);
+	unlink(new_path);
+	rmdir(dir);
+	if(failures)
+	{
+		fprintf(stderr, "test_journal: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("test_journal: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,231 @@
+/**
+ * @file      test_printer_driver.c
+ * @date      2026-10-17: Created
+ * @brief     Check how a printer copes with a job file that is cut short
+ * @copyright MIT License (c) 2015, 2016
+ *
+ * Installs a printer whose driver is a child process speaking the driver
+ * protocol over a pair of fifos, then prints a file that the driver
+ * truncates part way through, a file that cannot be opened, and a whole
+ * file.  A job whose file lets it down must fail on its own account, leave
+ * the driver in step and not mark it broken.  Build and run with
+ * `make check`; the exit status is non-zero if any check failed.
+ */
+
+/*
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "printer_driver.h"
+
+/// The size of the job file, far more than a fifo holds
+#define JOB_BYTES (1024 * 1024)
+/// How much of the file the driver reads before it truncates it
+#define TRUNCATE_AFTER 8192
+/// How long the driver may take over anything, so a bug fails, not hangs
+#define TIMEOUT_MS 5000
+
+int verbose_flag = 0;
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+static char dir[] = "/tmp/test_printer_driver.XXXXXX";
+static char driver[64], fifo_r[80], fifo_w[80], file[80];
+
+/**
+ * The driver.  It answers the install questions, counts the bytes of each
+ * job up to its ##END## line and answers ##DONE## if it got the whole file
+ * or ##FAILED## if it did not.  A job named "short" has its file truncated
+ * by the driver once the first bytes are in.
+ */
+static void fake_driver()
+{
+	char line[256];
+	struct stat st;
+	FILE * in, * out;
+	long long bytes = 0, size = 0;
+	int cut = 0;
+
+	in = fopen(fifo_r, "r");
+	out = fopen(fifo_w, "w");
+	if(in == NULL || out == NULL)
+		_exit(1);
+	while(fgets(line, sizeof(line), in))
+	{
+		if(strcmp(line, "##NAME##\n") == 0 || strcmp(line, "##DESCRIPTION##\n") == 0 || strcmp(line, "##LOCATION##\n") == 0)
+		{
+			fputs("fake\n", out);
+		}
+		else if(strncmp(line, "##NAME: ", 8) == 0)
+		{
+			cut = strcmp(line, "##NAME: short##\n") == 0;
+			bytes = 0;
+			size = stat(file, &st) == 0 ? st.st_size : -1;
+		}
+		else if(strcmp(line, "##END##\n") == 0)
+		{
+			fputs(bytes == size ? "##DONE##\n" : "##FAILED##\n", out);
+		}
+		else
+		{
+			bytes += strlen(line);
+			if(cut && bytes >= TRUNCATE_AFTER)
+			{
+				if(truncate(file, 0) == -1)
+					_exit(1);
+				cut = 0;
+			}
+		}
+		fflush(out);
+	}
+	_exit(0);
+}
+
+static void write_job_file()
+{
+	char line[64];
+	FILE * f = fopen(file, "w");
+	int i;
+
+	CHECK(f != NULL);
+	if(f == NULL)
+		return;
+	memset(line, 'x', sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\n';
+	for(i = 0; i < JOB_BYTES / (int)sizeof(line); i++)
+		fwrite(line, 1, sizeof(line), f);
+	fclose(f);
+}
+
+static int print(struct printer_driver * printer, const char * name, const char * file_name, int fd)
+{
+	struct print_job job;
+
+	memset(&job, 0, sizeof(job));
+	job.job_name = (char*)name;
+	job.file_name = (char*)file_name;
+	job.fd = fd;
+	return printer_print(printer, &job);
+}
+
+/**
+ * The driver must have answered for everything it was sent
+ */
+static void check_in_step(struct printer_driver * printer)
+{
+	CHECK(printer->broken == 0);
+	CHECK(printer->owed == 0);
+	CHECK(printer->reply_len == 0);
+}
+
+static void check_short_file(struct printer_driver * printer)
+{
+	int fd;
+
+	// a file cut short while it is copied, handed over as a descriptor
+	write_job_file();
+	fd = open(file, O_RDONLY);
+	CHECK(fd != -1);
+	CHECK(print(printer, "short", file, fd) == PRINTER_JOB_FAILED);
+	CHECK(printer->bad_file == 1);
+	check_in_step(printer);
+	close(fd);
+
+	// the same, opened by name
+	write_job_file();
+	CHECK(print(printer, "short", file, -1) == PRINTER_JOB_FAILED);
+	CHECK(printer->bad_file == 1);
+	check_in_step(printer);
+
+	// a file that is not there at all never reaches the driver
+	CHECK(print(printer, "missing", "/nonexistent/job.ps", -1) == PRINTER_JOB_FAILED);
+	CHECK(printer->bad_file == 1);
+	check_in_step(printer);
+
+	// and a whole file still prints on the same driver
+	write_job_file();
+	CHECK(print(printer, "whole", file, -1) == PRINTER_OK);
+	CHECK(printer->bad_file == 0);
+	check_in_step(printer);
+}
+
+int main()
+{
+	struct printer_driver printer;
+	pid_t pid;
+	int status;
+
+	// a driver that dies must show as an error, not kill the test
+	signal(SIGPIPE, SIG_IGN);
+	if(mkdtemp(dir) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(driver, sizeof(driver), "%s/printer", dir);
+	snprintf(fifo_r, sizeof(fifo_r), "%s-r", driver);
+	snprintf(fifo_w, sizeof(fifo_w), "%s-w", driver);
+	snprintf(file, sizeof(file), "%s/job.ps", dir);
+	if(mkfifo(fifo_r, 0600) || mkfifo(fifo_w, 0600))
+	{
+		perror("mkfifo");
+		return 1;
+	}
+	pid = fork();
+	if(pid == -1)
+	{
+		perror("fork");
+		return 1;
+	}
+	if(pid == 0)
+		fake_driver();
+
+	memset(&printer, 0, sizeof(printer));
+	printer.write_timeout_ms = printer.ack_timeout_ms = printer.install_timeout_ms = TIMEOUT_MS;
+	if(printer_install(&printer, driver))
+	{
+		CHECK(!"the driver could not be installed");
+		kill(pid, SIGKILL);
+	}
+	else
+	{
+		check_short_file(&printer);
+		// closing the fifos ends the driver
+		printer_uninstall(&printer);
+	}
+	waitpid(pid, &status, 0);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	unlink(file);
+	unlink(fifo_r);
+	unlink(fifo_w);
+	rmdir(dir);
+	if(failures)
+	{
+		fprintf(stderr, "test_printer_driver: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("test_printer_driver: all checks passed\n");
+	return 0;
+}